@@ -0,0 +1,592 @@
+#include "Assembler.h"
+#include "Tokenizer.h"
+
+#include <algorithm>
+
+namespace {
+// "0101 1010" for every byte value, so we don't need to printf every bit
+struct BinaryTable
+{
+    char bytes[256][10];
+
+    constexpr BinaryTable() : bytes() {
+        for (int value=0; value<256; value++) {
+            int position = 0;
+            for (int bit=7; bit>=0; bit--) {
+                bytes[value][position++] = (value >> bit) & 1 ? '1' : '0';
+                if (bit == 4) {
+                    bytes[value][position++] = ' ';
+                }
+            }
+            bytes[value][position] = '\0';
+        }
+    }
+};
+constexpr BinaryTable s_binaryTable;
+
+inline QLatin1String byteToBinary(const uint8_t value)
+{
+    return QLatin1String(s_binaryTable.bytes[value], 9);
+}
+
+inline QLatin1String nibbleToBinary(const uint8_t value)
+{
+    return QLatin1String(s_binaryTable.bytes[value & 0xF] + 5, 4);
+}
+
+const char s_hexDigits[] = "0123456789abcdef";
+} // namespace
+
+bool Assembler::Result::hasErrors() const
+{
+    for (const Diagnostic &diagnostic : diagnostics) {
+        if (diagnostic.severity == Diagnostic::Error) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QString Assembler::Result::memoryContents() const
+{
+    QString ret;
+    ret.reserve(memory.count() * 8);
+    for (uint32_t address = memory.first(); address < MemoryImage::Size; address = memory.next(address)) {
+        appendMemoryLine(&ret, address, memory.value(address));
+    }
+    return ret;
+}
+
+QString Assembler::memoryLine(const uint32_t address, const uint8_t value)
+{
+    QString ret;
+    appendMemoryLine(&ret, address, value);
+    return ret;
+}
+
+void Assembler::appendMemoryLine(QString *target, const uint32_t address, const uint8_t value)
+{
+    // Same as "%.2x %.2x\n"
+    char buffer[16];
+    int length = 0;
+
+    int digits = 2;
+    while (digits < 8 && (address >> (digits * 4))) {
+        digits++;
+    }
+    for (int i=digits - 1; i>=0; i--) {
+        buffer[length++] = s_hexDigits[(address >> (i * 4)) & 0xF];
+    }
+    buffer[length++] = ' ';
+    buffer[length++] = s_hexDigits[value >> 4];
+    buffer[length++] = s_hexDigits[value & 0xF];
+    buffer[length++] = '\n';
+
+    target->append(QLatin1String(buffer, length));
+}
+
+bool Assembler::Resolution::operator==(const Resolution &other) const
+{
+    return address == other.address &&
+        binary == other.binary &&
+        value == other.value &&
+        overwritten[0] == other.overwritten[0] &&
+        overwritten[1] == other.overwritten[1] &&
+        duplicateLabel == other.duplicateLabel &&
+        error == other.error;
+}
+
+Assembler::Result Assembler::assemble(const QString &source)
+{
+    setSource(source);
+    reassemble();
+    return m_result;
+}
+
+void Assembler::setSource(const QString &source)
+{
+    const QStringList lines = source.split('\n');
+
+    m_lines.clear();
+    m_lines.reserve(lines.count());
+    m_result.listing.clear();
+    m_result.listing.reserve(lines.count());
+
+    for (const QString &text : lines) {
+        Line line;
+        line.text = text;
+        line.statement = parse(text);
+        m_lines.append(line);
+        m_result.listing.append(QString());
+    }
+
+    m_dirty = true;
+}
+
+void Assembler::replaceLines(const int first, const int removedCount, const QStringList &lines)
+{
+    Q_ASSERT(first >= 0 && removedCount >= 0 && first + removedCount <= m_lines.count());
+
+    // By far the most common when typing, and QTextDocument likes to tell us
+    // about lines that didn't actually change (e. g. when highlighting).
+    if (removedCount == lines.count()) {
+        for (int i=0; i<lines.count(); i++) {
+            Line &line = m_lines[first + i];
+            if (line.text == lines[i]) {
+                continue;
+            }
+            line.text = lines[i];
+            line.statement = parse(line.text);
+            line.formatted = false;
+            m_dirty = true;
+        }
+        return;
+    }
+
+    QVector<Line> newLines;
+    newLines.reserve(m_lines.count() - removedCount + lines.count());
+    QStringList newListing;
+    newListing.reserve(newLines.capacity());
+
+    for (int i=0; i<first; i++) {
+        newLines.append(m_lines[i]);
+        newListing.append(m_result.listing[i]);
+    }
+    for (const QString &text : lines) {
+        Line line;
+        line.text = text;
+        line.statement = parse(text);
+        newLines.append(line);
+        newListing.append(QString());
+    }
+    for (int i=first + removedCount; i<m_lines.count(); i++) {
+        newLines.append(m_lines[i]);
+        newListing.append(m_result.listing[i]);
+    }
+
+    m_lines = std::move(newLines);
+    m_result.listing = std::move(newListing);
+    m_dirty = true;
+}
+
+QVector<int> Assembler::reassemble()
+{
+    QVector<int> changedLines;
+    if (!m_dirty) {
+        return changedLines;
+    }
+    m_dirty = false;
+
+    m_labels.clear();
+    m_memoryOwners.resize(MemoryImage::Size);
+    m_fixups.clear();
+    m_result.memory.clear();
+    m_result.diagnostics.clear();
+
+    int num = 0;
+    for (m_lineNumber = 0; m_lineNumber < m_lines.count(); m_lineNumber++) {
+        Resolution resolution;
+        if (!resolve(m_lines[m_lineNumber].statement, &resolution, &num)) {
+            m_fixups.append({m_lineNumber, resolution});
+            continue;
+        }
+        commit(m_lineNumber, resolution, &changedLines);
+    }
+
+    if (m_fixups.isEmpty()) {
+        return changedLines;
+    }
+
+    for (Fixup &fixup : m_fixups) {
+        applyFixup(&fixup);
+        commit(fixup.line, fixup.resolution, &changedLines);
+    }
+
+    std::sort(changedLines.begin(), changedLines.end());
+    std::stable_sort(m_result.diagnostics.begin(), m_result.diagnostics.end(), [](const Diagnostic &a, const Diagnostic &b) {
+        return a.line < b.line;
+    });
+
+    return changedLines;
+}
+
+void Assembler::commit(const int line, const Resolution &resolution, QVector<int> *changedLines)
+{
+    Line &cached = m_lines[line];
+    if (cached.formatted && resolution == cached.resolution) {
+        return;
+    }
+
+    cached.resolution = resolution;
+    if (!m_listingEnabled) {
+        return;
+    }
+
+    cached.formatted = true;
+    m_result.listing[line] = format(cached.statement, cached.resolution);
+    changedLines->append(line);
+}
+
+int Assembler::lineForAddress(const uint32_t address) const
+{
+    if (address >= uint32_t(m_memoryOwners.count()) || !m_result.memory.contains(address)) {
+        return -1;
+    }
+    return m_memoryOwners[address];
+}
+
+void Assembler::setListingEnabled(const bool enabled)
+{
+    if (enabled == m_listingEnabled) {
+        return;
+    }
+    m_listingEnabled = enabled;
+
+    for (int i=0; i<m_lines.count(); i++) {
+        m_lines[i].formatted = false;
+        m_result.listing[i].clear();
+    }
+    m_dirty = true;
+}
+
+void Assembler::addDiagnostic(const Diagnostic::Severity severity, const QString &message)
+{
+    Diagnostic diagnostic;
+    diagnostic.severity = severity;
+    diagnostic.line = m_lineNumber;
+    diagnostic.message = message;
+    m_result.diagnostics.append(diagnostic);
+}
+
+Assembler::Statement Assembler::parse(const QString &line) const
+{
+    Statement statement;
+
+    // We never need more than ".db address value label"
+    Token tokens[4];
+    int tokenCount = 0;
+    int end = line.length();
+
+    Tokenizer tokenizer(line);
+    Token token;
+    while (tokenizer.next(&token)) {
+        if (token.type == Token::Comment) {
+            end = token.start;
+            break;
+        }
+        if (tokenCount < 4) {
+            tokens[tokenCount] = token;
+        }
+        tokenCount++;
+    }
+    if (tokenCount == 0) {
+        return statement;
+    }
+
+    const Token &op = tokens[0];
+    if (op.type == Token::Label) {
+        statement.kind = Statement::Label;
+        statement.name = op.text.toString().toLower();
+        return statement;
+    }
+
+    int argumentIndex = 1;
+    if (op.type == Token::Directive && op.text.compare(QStringView(u".db"), Qt::CaseInsensitive) == 0) {
+        if (tokenCount < 3) {
+            statement.kind = Statement::Invalid;
+            statement.error = "Syntax: .db address value [label]";
+            return statement;
+        }
+        int address = 0;
+        if (!Tokenizer::parseNumber(tokens[1].text, &address)) {
+            statement.kind = Statement::Invalid;
+            statement.error = "Invalid value '" + tokens[1].text.toString() + "'";
+            return statement;
+        }
+        statement.dataAddress = address;
+        if (statement.dataAddress > 0xFF) {
+            statement.kind = Statement::Invalid;
+            statement.error = "Address out of range: " + QString::number(statement.dataAddress);
+            return statement;
+        }
+        if (tokenCount > 3) {
+            statement.dataLabel = tokens[3].text.toString();
+        }
+        statement.kind = Statement::Data;
+        argumentIndex = 2;
+    } else {
+        const CPU::Operator *cpuOperator = m_cpu.findOperator(op.text);
+        if (!cpuOperator) {
+            statement.kind = Statement::Invalid;
+            statement.error = "Invalid operator '" + op.text.toString().toLower() + "'";
+            return statement;
+        }
+        if (tokenCount != cpuOperator->numArguments + 1) {
+            statement.kind = Statement::Invalid;
+            statement.error = "Operator '" + op.text.toString().toLower() + "' takes " + QString::number(cpuOperator->numArguments) + " argument(s)";
+            return statement;
+        }
+        statement.kind = Statement::Instruction;
+        statement.opcode = cpuOperator->opcode;
+        statement.help = cpuOperator->help;
+        statement.source = line.left(end).simplified();
+    }
+
+    if (tokenCount > argumentIndex) {
+        const Token &argument = tokens[argumentIndex];
+        statement.argument = argument.text.toString();
+
+        int number = 0;
+        statement.argumentIsNumber = Tokenizer::parseNumber(argument.text, &number);
+        statement.argumentNumber = number;
+    }
+
+    return statement;
+}
+
+int Assembler::byteCount(const Statement &statement) const
+{
+    if (statement.kind == Statement::Data || m_cpu.bits() == 8) {
+        return 1;
+    }
+    return 2;
+}
+
+void Assembler::write(Resolution *resolution, const int index, const uint32_t address, const uint8_t value)
+{
+    if (m_result.memory.contains(address)) {
+        // TODO: track line numbers
+        const uint8_t existing = m_result.memory.value(address);
+        resolution->overwritten[index] = existing;
+        QString message = QStringLiteral("overwrites ");
+        message += byteToBinary(existing);
+        message += QLatin1String(" at ");
+        message += byteToBinary(uint8_t(address));
+        addDiagnostic(Diagnostic::Warning, message);
+    }
+    m_result.memory.set(address, value);
+    m_memoryOwners[address] = m_lineNumber;
+}
+
+bool Assembler::setValue(const Statement &statement, Resolution *resolution, const int value)
+{
+    // Only 4 bits for the operand in 8 bit instructions, otherwise a whole
+    // byte (negative numbers as two's complement)
+    bool inRange = value >= -128 && value <= 0xFF;
+    if (m_cpu.bits() == 8 && statement.kind == Statement::Instruction) {
+        inRange = value >= 0 && value <= 0xF;
+    }
+    if (!inRange) {
+        resolution->error = "Value out of range: " + QString::number(value);
+        addDiagnostic(Diagnostic::Error, resolution->error);
+        return false;
+    }
+    resolution->value = value & 0xFF;
+
+    if (m_cpu.bits() == 8) {
+        resolution->binary |= value & 0xF;
+    } else {
+        if (statement.kind == Statement::Data) {
+            resolution->binary |= (value & 0xFF);
+        } else {
+            resolution->binary |= (value & 0xFF) << 8;
+        }
+    }
+    return true;
+}
+
+bool Assembler::resolve(const Statement &statement, Resolution *resolution, int *num)
+{
+    switch(statement.kind) {
+    case Statement::Empty:
+        return true;
+    case Statement::Invalid:
+        addDiagnostic(Diagnostic::Error, statement.error);
+        return true;
+    case Statement::Label:
+        if (m_labels.contains(statement.name)) {
+            resolution->duplicateLabel = true;
+            addDiagnostic(Diagnostic::Warning, "label '" + statement.name + "' already exists");
+            return true;
+        }
+        m_labels.insert(statement.name, *num);
+        return true;
+    case Statement::Data:
+        resolution->address = statement.dataAddress;
+        if (!statement.dataLabel.isEmpty()) {
+            if (m_labels.contains(statement.dataLabel)) {
+                resolution->duplicateLabel = true;
+                addDiagnostic(Diagnostic::Warning, "label '" + statement.dataLabel + "' already exists");
+            } else {
+                m_labels.insert(statement.dataLabel, statement.dataAddress);
+            }
+        }
+        break;
+    case Statement::Instruction:
+        if (m_cpu.bits() == 8) {
+            resolution->binary = statement.opcode << 4;
+            (*num)++;
+            resolution->address = *num;
+        } else {
+            resolution->binary = statement.opcode;
+            resolution->address = *num;
+            *num += 2;
+        }
+        break;
+    }
+
+    if (resolution->address + byteCount(statement) > m_cpu.addressCount()) {
+        resolution->error = "Address out of range: " + QString::number(resolution->address);
+        addDiagnostic(Diagnostic::Error, resolution->error);
+        return true;
+    }
+
+    bool resolved = true;
+    if (!statement.argument.isEmpty()) {
+        const QHash<QString, uint32_t>::const_iterator label = m_labels.constFind(statement.argument);
+        if (label != m_labels.constEnd()) {
+            if (!setValue(statement, resolution, int(label.value()))) {
+                return true;
+            }
+        } else if (statement.argumentIsNumber) {
+            if (!setValue(statement, resolution, statement.argumentNumber)) {
+                return true;
+            }
+        } else {
+            // Not defined yet, so reserve the space now and fill in the value at the end
+            resolved = false;
+        }
+    }
+
+    for (int i=0; i<byteCount(statement); i++) {
+        write(resolution, i, resolution->address + i, uint8_t(resolution->binary >> (8 * i)));
+    }
+
+    return resolved;
+}
+
+void Assembler::applyFixup(Fixup *fixup)
+{
+    m_lineNumber = fixup->line;
+    const Statement &statement = m_lines[fixup->line].statement;
+    Resolution *resolution = &fixup->resolution;
+
+    bool ok = false;
+    const QHash<QString, uint32_t>::const_iterator label = m_labels.constFind(statement.argument);
+    if (label != m_labels.constEnd()) {
+        ok = setValue(statement, resolution, int(label.value()));
+    } else {
+        resolution->error = "Invalid value '" + statement.argument + "'";
+        addDiagnostic(Diagnostic::Error, resolution->error);
+    }
+
+    for (int i=0; i<byteCount(statement); i++) {
+        const uint32_t address = resolution->address + i;
+
+        // If someone after us wrote here they win, like they would if we had resolved this right away
+        if (!m_result.memory.contains(address) || m_memoryOwners[address] != fixup->line) {
+            continue;
+        }
+
+        if (ok) {
+            m_result.memory.set(address, uint8_t(resolution->binary >> (8 * i)));
+            continue;
+        }
+
+        // Invalid, so we shouldn't have been written at all
+        m_memoryOwners[address] = -1;
+        if (resolution->overwritten[i] != -1) {
+            m_result.memory.set(address, resolution->overwritten[i]);
+        } else {
+            m_result.memory.remove(address);
+        }
+    }
+}
+
+QString Assembler::format(const Statement &statement, const Resolution &resolution) const
+{
+    switch(statement.kind) {
+    case Statement::Empty:
+        return QString();
+    case Statement::Invalid:
+        return "; " + statement.error + "\n";
+    case Statement::Label:
+        if (resolution.duplicateLabel) {
+            return " ; WARNING: label '" + statement.name + "' already exists\n";
+        }
+        return " ; Label '" + statement.name + "'\n";
+    default:
+        break;
+    }
+
+    if (!resolution.error.isEmpty()) {
+        return "; " + resolution.error + "\n";
+    }
+
+    QString helpText;
+    if (statement.kind == Statement::Data) {
+        helpText = QString("Memory content at %1 is %2");
+        if (!statement.dataLabel.isEmpty()) {
+            helpText += " (named " + statement.dataLabel + ")";
+        }
+        helpText = helpText.arg(resolution.address).arg(resolution.value);
+        if (resolution.duplicateLabel) {
+            helpText += " WARNING: label '" + statement.dataLabel + "' already exists";
+        }
+    } else {
+        helpText = statement.help;
+        if (!statement.argument.isEmpty()) {
+            helpText = helpText.arg(resolution.value);
+        }
+    }
+
+    QString ret;
+    ret.reserve(64 + statement.source.length() + helpText.length() * 2);
+    if (m_cpu.bits() == 16 && statement.kind == Statement::Instruction) {
+        ret += QLatin1String("; ");
+        ret += statement.source;
+        ret += QLatin1String(": ");
+        ret += helpText;
+        ret += QLatin1Char('\n');
+        helpText.clear();
+    }
+
+    uint32_t address = resolution.address;
+    uint16_t binary = resolution.binary;
+    for (int i=0; i<2; i++) {
+        if (resolution.overwritten[i] != -1) {
+            helpText += QLatin1String(" WARNING: overwrites ");
+            helpText += byteToBinary(resolution.overwritten[i]);
+            helpText += QLatin1String(" at ");
+            helpText += byteToBinary(uint8_t(address));
+            helpText += QLatin1Char('!');
+        }
+
+        if (m_cpu.bits() == 8) {
+            ret += nibbleToBinary(address);
+        } else {
+            ret += byteToBinary(uint8_t(address));
+        }
+        ret += QLatin1String(": ");
+        ret += byteToBinary(binary & 0xFF);
+
+        if (!helpText.isEmpty()) {
+            ret += QLatin1String("\t; ");
+            ret += helpText;
+        }
+
+        if (statement.kind == Statement::Data) {
+            ret += QLatin1Char('\n');
+            break;
+        }
+
+        if (m_cpu.bits() == 8) {
+            break;
+        }
+
+        address++;
+        binary >>= 8;
+        ret += QLatin1Char('\n');
+    }
+    return ret;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "CPU.h"
+#include "MemoryImage.h"
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
+
+// Turns assembly source into a memory image, without any widgets involved, so
+// it can be used from the command line and benchmarks as well as the editor.
+//
+// Lines are parsed once and cached, so when editing only the lines that
+// actually changed are parsed again, and only the lines whose address, value
+// or warnings changed get a new listing.
+//
+// Everything is resolved in a single pass, references to labels that aren't
+// defined yet are recorded as fixups and patched when we reach the end.
+class Assembler
+{
+public:
+    struct Diagnostic
+    {
+        enum Severity {
+            Warning,
+            Error
+        };
+        Severity severity = Error;
+        int line = -1; // zero-based source line
+        QString message;
+    };
+
+    struct Result
+    {
+        MemoryImage memory;
+
+        // One entry per source line, empty for lines that don't produce anything
+        QStringList listing;
+
+        QVector<Diagnostic> diagnostics;
+
+        bool hasErrors() const;
+
+        // Newline separated "address value" pairs in hex, what we upload
+        QString memoryContents() const;
+    };
+
+    explicit Assembler(const CPU &cpu) : m_cpu(cpu) {}
+
+    // Assembles everything from scratch
+    Result assemble(const QString &source);
+
+    // Incremental interface, for the editor
+    void setSource(const QString &source);
+    void replaceLines(const int first, const int removedCount, const QStringList &lines);
+    int lineCount() const { return m_lines.count(); }
+
+    // Returns the (sorted) lines whose listing changed since the last call
+    QVector<int> reassemble();
+    const Result &result() const { return m_result; }
+
+    // Which source line the value at an address came from, -1 if none
+    int lineForAddress(const uint32_t address) const;
+
+    // Building the listing is most of the work, so skip it if we only need the memory
+    void setListingEnabled(const bool enabled);
+    bool isListingEnabled() const { return m_listingEnabled; }
+
+    static QString memoryLine(const uint32_t address, const uint8_t value);
+    static void appendMemoryLine(QString *target, const uint32_t address, const uint8_t value);
+
+private:
+    // Everything we can figure out from a line without knowing the labels or where it ends up
+    struct Statement
+    {
+        enum Kind {
+            Empty,
+            Label,
+            Data,
+            Instruction,
+            Invalid
+        };
+        Kind kind = Empty;
+
+        QString name; // label name or operator
+        QString argument; // number or label
+        bool argumentIsNumber = false;
+        int argumentNumber = 0; // range checked when resolving, so we can say what was wrong
+
+        uint8_t opcode = 0;
+        QString help;
+        QString source; // the instruction itself, for the comment in 16 bit mode
+
+        uint32_t dataAddress = 0;
+        QString dataLabel;
+
+        QString error;
+    };
+
+    // What the listing depends on besides the statement itself
+    struct Resolution
+    {
+        uint32_t address = 0;
+        uint16_t binary = 0;
+        int value = -1;
+        int overwritten[2] = { -1, -1 }; // what was there before us, if anything
+        bool duplicateLabel = false;
+        QString error;
+
+        bool operator==(const Resolution &other) const;
+        bool operator!=(const Resolution &other) const { return !(*this == other); }
+    };
+
+    struct Line
+    {
+        QString text;
+        Statement statement;
+        Resolution resolution;
+        bool formatted = false;
+    };
+
+    // A forward reference, the value is filled in when all labels are known
+    struct Fixup
+    {
+        int line = -1;
+        Resolution resolution;
+    };
+
+    Statement parse(const QString &line) const;
+
+    // Returns false if the value needs a fixup
+    bool resolve(const Statement &statement, Resolution *resolution, int *num);
+    bool setValue(const Statement &statement, Resolution *resolution, const int value);
+    void applyFixup(Fixup *fixup);
+    int byteCount(const Statement &statement) const;
+    void write(Resolution *resolution, const int index, const uint32_t address, const uint8_t value);
+    void commit(const int line, const Resolution &resolution, QVector<int> *changedLines);
+    QString format(const Statement &statement, const Resolution &resolution) const;
+
+    void addDiagnostic(const Diagnostic::Severity severity, const QString &message);
+
+    const CPU &m_cpu;
+
+    QVector<Line> m_lines;
+    bool m_dirty = true;
+    bool m_listingEnabled = true;
+
+    QHash<QString, uint32_t> m_labels;
+    QVector<int> m_memoryOwners; // which line wrote each address, only valid where memory is set
+    QVector<Fixup> m_fixups;
+
+    Result m_result;
+    int m_lineNumber = 0; // only valid while resolving
+};
@@ -0,0 +1,421 @@
+#include "Assembler.h"
+#include "CPU.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDateTime>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+// Measures how fast we assemble synthetic programs of various sizes, so we
+// can tell if something regressed. Run it with --json and keep the output
+// around to compare against.
+
+// The address sanitizer has its own allocator, and frees with that whatever
+// we hand out, so leave the allocator alone and don't count anything then.
+#if defined(__SANITIZE_ADDRESS__)
+#define NO_ALLOCATION_COUNT
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define NO_ALLOCATION_COUNT
+#endif
+#endif
+
+namespace {
+std::atomic<uint64_t> s_allocations(0);
+}
+
+#if defined(NO_ALLOCATION_COUNT)
+#elif defined(__GLIBC__)
+// Qt allocates most of its stuff with malloc directly, so we need to count
+// there and not only in operator new (which calls malloc anyway). The
+// obsolete valloc and pvalloc aren't counted, nothing we use calls them.
+extern "C" {
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size)
+{
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *memory = __libc_memalign(alignment, size);
+    if (!memory) {
+        return ENOMEM;
+    }
+    *pointer = memory;
+    return 0;
+}
+} // extern "C"
+#else
+// Best effort elsewhere, misses whatever Qt mallocs itself
+void *operator new(size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+#endif
+
+namespace {
+
+struct Phase
+{
+    const char *name;
+    qint64 nsecs = std::numeric_limits<qint64>::max(); // best of all iterations
+    uint64_t allocations = 0;
+};
+
+// -1 if we don't count them
+double allocationsPerLine(const uint64_t allocations, const int lines)
+{
+#if defined(NO_ALLOCATION_COUNT)
+    Q_UNUSED(allocations);
+    Q_UNUSED(lines);
+    return -1.;
+#else
+    return double(allocations) / lines;
+#endif
+}
+
+// In kilobytes, -1 if we don't know how
+qint64 peakRss()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#ifdef Q_OS_MACOS
+    return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
+
+// Something that looks like a real program: labels, comments, data, and
+// references to labels both before and after where they're defined. As many
+// instructions as fit in the memory of the CPU, so everything assembles
+// without any errors or warnings.
+QString generateProgram(const CPU &cpu)
+{
+    QStringList withArgument, withoutArgument;
+    for (QHash<QString, CPU::Operator>::const_iterator it = cpu.operators().constBegin(); it != cpu.operators().constEnd(); ++it) {
+        if (it->numArguments) {
+            withArgument.append(it.key());
+        } else {
+            withoutArgument.append(it.key());
+        }
+    }
+    // The hash is randomly seeded, and we want the same program every time
+    std::sort(withArgument.begin(), withArgument.end());
+    std::sort(withoutArgument.begin(), withoutArgument.end());
+    if (withArgument.isEmpty()) {
+        withArgument = withoutArgument; // just so we have something, will error
+    }
+    if (withoutArgument.isEmpty()) {
+        withoutArgument = withArgument;
+    }
+
+    // 4 bit arguments on the 8 bit CPU, so keep the data where we can reach it
+    const bool small = cpu.bits() == 8;
+
+    // The data goes in the last two addresses, and the 8 bit CPU starts
+    // putting instructions at 1
+    const uint32_t dataAddress = cpu.addressCount() - 2;
+    const int instructionCount = int(dataAddress) / (small ? 1 : 2) - 1;
+
+    QString program;
+    program += ".db " + QString::number(dataAddress) + " 3 x\n";
+    program += ".db " + QString::number(dataAddress + 1) + " 0x7 y ; the other one\n";
+
+    // Five instructions in each
+    const int blockCount = instructionCount / 5;
+    for (int block = 0; block < blockCount; block++) {
+        const QString &op = withArgument[block % withArgument.count()];
+        program += "loop" + QString::number(block) + ":\n";
+        program += "    " + op + " x\n";
+        program += "    " + op + " 0x3 ; with a comment\n";
+        program += "    " + withoutArgument[block % withoutArgument.count()] + "\n";
+        if (small) {
+            program += "    " + op + " y\n";
+        } else {
+            program += "    " + op + " loop" + QString::number(block + 1) + "\n"; // forward
+        }
+        program += "\n";
+        program += "; just a comment\n";
+        if (small) {
+            program += "    " + op + " " + QString::number(block % 16) + "\n";
+        } else {
+            program += "    " + op + " loop" + QString::number(block) + "\n"; // backward
+        }
+    }
+    program += "loop" + QString::number(blockCount) + ":\n";
+    return program;
+}
+
+// A big program won't fit in the machine, so we assemble the same one over
+// and over in separate assemblers until we've done lineCount lines
+QJsonObject runBenchmark(const CPU &cpu, const QString &cpuName, const int lineCount, const int iterations)
+{
+    const QString source = generateProgram(cpu);
+    const int programLines = source.count('\n');
+    const int programCount = qMax(1, lineCount / programLines);
+    const int totalLines = programCount * programLines;
+    const QString editedLine = source.section('\n', programLines / 2, programLines / 2) + " ; edited";
+
+    Phase parse{"parse"}, assemble{"assemble"}, output{"output"}, edit{"edit"}, memoryOnly{"memory_only"};
+    int diagnostics = 0;
+    int bytes = 0;
+
+    for (int i=0; i<iterations; i++) {
+        std::vector<Assembler> assemblers;
+        assemblers.reserve(programCount);
+        for (int program = 0; program < programCount; program++) {
+            assemblers.emplace_back(cpu);
+        }
+        QElapsedTimer timer;
+
+        // Splitting up the lines and tokenizing them
+        uint64_t allocations = s_allocations.load();
+        timer.start();
+        for (Assembler &assembler : assemblers) {
+            assembler.setSource(source);
+        }
+        parse.nsecs = qMin(parse.nsecs, timer.nsecsElapsed());
+        parse.allocations = s_allocations.load() - allocations;
+
+        // Resolving labels, writing memory and building the listing
+        allocations = s_allocations.load();
+        timer.restart();
+        for (Assembler &assembler : assemblers) {
+            assembler.reassemble();
+        }
+        assemble.nsecs = qMin(assemble.nsecs, timer.nsecsElapsed());
+        assemble.allocations = s_allocations.load() - allocations;
+
+        // What we show and upload
+        allocations = s_allocations.load();
+        timer.restart();
+        for (const Assembler &assembler : assemblers) {
+            const QString memoryContents = assembler.result().memoryContents();
+            const QString listing = assembler.result().listing.join('\n');
+            Q_UNUSED(memoryContents);
+            Q_UNUSED(listing);
+        }
+        output.nsecs = qMin(output.nsecs, timer.nsecsElapsed());
+        output.allocations = s_allocations.load() - allocations;
+
+        // Typing in the middle of the file
+        allocations = s_allocations.load();
+        timer.restart();
+        for (Assembler &assembler : assemblers) {
+            assembler.replaceLines(programLines / 2, 1, {editedLine});
+            assembler.reassemble();
+        }
+        edit.nsecs = qMin(edit.nsecs, timer.nsecsElapsed());
+        edit.allocations = s_allocations.load() - allocations;
+
+        // Without the listing, like when uploading or from the command line
+        for (Assembler &assembler : assemblers) {
+            assembler.setListingEnabled(false);
+        }
+        allocations = s_allocations.load();
+        timer.restart();
+        for (Assembler &assembler : assemblers) {
+            assembler.reassemble();
+        }
+        memoryOnly.nsecs = qMin(memoryOnly.nsecs, timer.nsecsElapsed());
+        memoryOnly.allocations = s_allocations.load() - allocations;
+
+        diagnostics = 0;
+        bytes = 0;
+        for (const Assembler &assembler : assemblers) {
+            diagnostics += assembler.result().diagnostics.count();
+            bytes += assembler.result().memory.count();
+        }
+    }
+
+    QJsonObject result;
+    result["cpu"] = cpuName;
+    result["lines"] = totalLines;
+    result["programs"] = programCount;
+    result["iterations"] = iterations;
+    result["bytes"] = bytes;
+    result["diagnostics"] = diagnostics;
+
+    QJsonObject phases;
+    for (const Phase &phase : {parse, assemble, output, edit, memoryOnly}) {
+        QJsonObject phaseObject;
+        phaseObject["ms"] = phase.nsecs / 1000000.;
+        phaseObject["lines_per_second"] = totalLines * 1000000000. / qMax<qint64>(phase.nsecs, 1);
+        phaseObject["allocations_per_line"] = allocationsPerLine(phase.allocations, totalLines);
+        phases[phase.name] = phaseObject;
+    }
+    const qint64 totalNsecs = parse.nsecs + assemble.nsecs + output.nsecs;
+    result["phases"] = phases;
+    result["lines_per_second"] = totalLines * 1000000000. / qMax<qint64>(totalNsecs, 1);
+    result["allocations_per_line"] = allocationsPerLine(parse.allocations + assemble.allocations + output.allocations, totalLines);
+    result["peak_rss_kb"] = peakRss();
+
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationDomain("iskrembilen.com");
+    app.setApplicationName("8bit-asm-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks the assembler on synthetic programs");
+    parser.addHelpOption();
+    QCommandLineOption cpuOption({"c", "cpu"}, "CPU specification file, can be given multiple times. Defaults to both bundled ones.", "file");
+    parser.addOption(cpuOption);
+    QCommandLineOption maxLinesOption({"m", "max-lines"}, "Largest program to assemble, defaults to 1048576.", "lines", "1048576");
+    parser.addOption(maxLinesOption);
+    QCommandLineOption jsonOption({"j", "json"}, "Write the results as JSON to this file, - for stdout.", "file");
+    parser.addOption(jsonOption);
+    parser.process(app);
+
+    QStringList cpuFiles = parser.values(cpuOption);
+    if (cpuFiles.isEmpty()) {
+        cpuFiles = QStringList{":/cpu-original.txt", ":/cpu-extended.txt"};
+    }
+    const int maxLines = parser.value(maxLinesOption).toInt();
+    if (maxLines < 16) {
+        fprintf(stderr, "Invalid max lines %s\n", qPrintable(parser.value(maxLinesOption)));
+        return 1;
+    }
+
+    const bool jsonToStdout = parser.value(jsonOption) == "-";
+
+    QJsonArray results;
+    for (const QString &cpuFile : cpuFiles) {
+        CPU cpu;
+        if (!cpu.loadFile(cpuFile) || !cpu.isValid()) {
+            fprintf(stderr, "Failed to load CPU %s: %s\n", qPrintable(cpuFile), qPrintable(cpu.errorString()));
+            return 1;
+        }
+        const QString cpuName = QFileInfo(cpuFile).fileName();
+
+        int previousPrograms = 0;
+        for (int lineCount = 16; lineCount <= maxLines; lineCount *= 4) {
+            // Enough iterations that the small ones aren't just noise
+            const int iterations = qBound(3, (1 << 20) / lineCount, 1000);
+
+            const QJsonObject result = runBenchmark(cpu, cpuName, lineCount, iterations);
+            if (result["diagnostics"].toInt() != 0) {
+                // Then we'd be measuring the error paths and not the normal ones
+                fprintf(stderr, "The generated program for %s doesn't assemble cleanly, %d diagnostics\n", qPrintable(cpuName), result["diagnostics"].toInt());
+                return 1;
+            }
+            if (result["programs"].toInt() == previousPrograms) {
+                continue; // still smaller than one program, so the same as last time
+            }
+            previousPrograms = result["programs"].toInt();
+            results.append(result);
+
+            if (!jsonToStdout) {
+                const QJsonObject phases = result["phases"].toObject();
+                printf("%-18s %8d lines %12.0f lines/s %8.2f allocs/line  parse %9.3f ms  assemble %9.3f ms  output %9.3f ms  edit %8.3f ms  memory only %9.3f ms  rss %lld kB\n",
+                        qPrintable(cpuName),
+                        result["lines"].toInt(),
+                        result["lines_per_second"].toDouble(),
+                        result["allocations_per_line"].toDouble(),
+                        phases["parse"].toObject()["ms"].toDouble(),
+                        phases["assemble"].toObject()["ms"].toDouble(),
+                        phases["output"].toObject()["ms"].toDouble(),
+                        phases["edit"].toObject()["ms"].toDouble(),
+                        phases["memory_only"].toObject()["ms"].toDouble(),
+                        qint64(result["peak_rss_kb"].toDouble()));
+                fflush(stdout);
+            }
+        }
+    }
+
+    if (!parser.isSet(jsonOption)) {
+        return 0;
+    }
+
+    QJsonObject root;
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["results"] = results;
+    const QByteArray json = QJsonDocument(root).toJson();
+
+    if (jsonToStdout) {
+        fwrite(json.constData(), 1, json.size(), stdout);
+        return 0;
+    }
+
+    QFile file(parser.value(jsonOption));
+    if (!file.open(QIODevice::WriteOnly)) {
+        fprintf(stderr, "Failed to open %s: %s\n", qPrintable(file.fileName()), qPrintable(file.errorString()));
+        return 1;
+    }
+    file.write(json);
+
+    return 0;
+}
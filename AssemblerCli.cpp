@@ -0,0 +1,244 @@
+#include "Assembler.h"
+#include "CPU.h"
+#include "Emulator.h"
+#include "TraceRecorder.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QThread>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdio>
+
+// Batch assembler, so we don't need to open every program in the editor
+// to get the memory image out of it.
+
+namespace {
+struct Job
+{
+    QString inputPath;
+    QString outputPath;
+    QString tracePath;
+
+    bool ok = false;
+    qint64 nsecs = 0;
+    int lines = 0;
+    int bytes = 0;
+    QStringList messages;
+};
+
+struct RunOptions
+{
+    bool enabled = false;
+    bool trace = false;
+    uint64_t maxInstructions = 0;
+};
+
+void runProgram(const CPU &cpu, const MemoryImage &memory, const RunOptions &options, Job *job)
+{
+    Emulator emulator(cpu);
+    emulator.load(memory);
+
+    TraceRecorder trace;
+    if (options.trace) {
+        if (!trace.open(job->tracePath, emulator)) {
+            job->messages.append(job->tracePath + ": error: " + trace.errorString());
+            job->ok = false;
+            return;
+        }
+        emulator.setTraceRecorder(&trace);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const Emulator::StopReason reason = emulator.run(options.maxInstructions);
+    const qint64 nsecs = timer.nsecsElapsed();
+
+    if (options.trace && !trace.close()) {
+        job->messages.append(job->tracePath + ": error: " + trace.errorString());
+        job->ok = false;
+    }
+
+    QString outputs;
+    for (const Emulator::Output &output : emulator.outputs()) {
+        outputs += " " + QString::number(output.value);
+    }
+
+    const Emulator::State &state = emulator.state();
+    QString status;
+    switch(reason) {
+    case Emulator::Halted:
+        status = "halted";
+        break;
+    case Emulator::InstructionLimit:
+        status = "still running";
+        break;
+    case Emulator::InvalidOpcode:
+        status = "invalid opcode at " + QString::number(state.pc);
+        job->ok = false;
+        break;
+    }
+    status += " after " + QString::number(state.instructions) + " instructions, " + QString::number(state.cycles) + " cycles";
+    if (nsecs > 0 && state.instructions > 1000) {
+        status += QString::asprintf(", %.1f M instructions/s", state.instructions * 1000. / nsecs);
+    }
+
+    job->messages.append(job->inputPath + ": output:" + outputs + " (" + status + ")");
+}
+
+void assembleFile(const CPU &cpu, const RunOptions &runOptions, Job *job)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QFile input(job->inputPath);
+    if (!input.open(QIODevice::ReadOnly)) {
+        job->messages.append(job->inputPath + ": error: " + input.errorString());
+        return;
+    }
+    const QString source = QString::fromUtf8(input.readAll());
+
+    Assembler assembler(cpu);
+    assembler.setListingEnabled(false); // we only write out the memory
+    const Assembler::Result result = assembler.assemble(source);
+
+    for (const Assembler::Diagnostic &diagnostic : result.diagnostics) {
+        const QString severity = diagnostic.severity == Assembler::Diagnostic::Error ? "error" : "warning";
+        job->messages.append(job->inputPath + ":" + QString::number(diagnostic.line + 1) + ": " + severity + ": " + diagnostic.message);
+    }
+    job->lines = result.listing.count();
+    job->bytes = result.memory.count();
+
+    if (result.hasErrors()) {
+        job->nsecs = timer.nsecsElapsed();
+        return;
+    }
+
+    QFile output(job->outputPath);
+    if (!output.open(QIODevice::WriteOnly)) {
+        job->messages.append(job->outputPath + ": error: " + output.errorString());
+        return;
+    }
+    output.write(result.memoryContents().toLatin1());
+
+    job->nsecs = timer.nsecsElapsed();
+    job->ok = true;
+
+    if (runOptions.enabled) {
+        runProgram(cpu, result.memory, runOptions, job);
+    }
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationDomain("iskrembilen.com");
+    app.setApplicationName("8bit-asm");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Assembles .basm files into memory images");
+    parser.addHelpOption();
+    QCommandLineOption cpuOption({"c", "cpu"}, "CPU specification file, defaults to the bundled cpu-original.txt.", "file", ":/cpu-original.txt");
+    parser.addOption(cpuOption);
+    QCommandLineOption outputOption({"o", "output-dir"}, "Where to write the memory images, defaults to next to the input files.", "directory");
+    parser.addOption(outputOption);
+    QCommandLineOption jobsOption({"j", "jobs"}, "Number of files to assemble in parallel, defaults to the number of cores.", "count");
+    parser.addOption(jobsOption);
+    QCommandLineOption runOption({"r", "run"}, "Run the programs in the emulator after assembling them, and print what they output.");
+    parser.addOption(runOption);
+    QCommandLineOption maxInstructionsOption("max-instructions", "How long to let programs run before giving up, defaults to 10000000.", "count", "10000000");
+    parser.addOption(maxInstructionsOption);
+    QCommandLineOption traceOption("trace", "Record every step of the run next to the memory image (foo.trace), implies --run.");
+    parser.addOption(traceOption);
+    parser.addPositionalArgument("files", "Assembly files to assemble.", "files...");
+    parser.process(app);
+
+    const QStringList inputs = parser.positionalArguments();
+    if (inputs.isEmpty()) {
+        parser.showHelp(1);
+    }
+
+    CPU cpu;
+    if (!cpu.loadFile(parser.value(cpuOption)) || !cpu.isValid()) {
+        fprintf(stderr, "Failed to load CPU %s: %s\n", qPrintable(parser.value(cpuOption)), qPrintable(cpu.errorString()));
+        return 1;
+    }
+
+    RunOptions runOptions;
+    runOptions.trace = parser.isSet(traceOption);
+    runOptions.enabled = parser.isSet(runOption) || runOptions.trace;
+    runOptions.maxInstructions = parser.value(maxInstructionsOption).toULongLong();
+
+    QDir outputDir;
+    const bool hasOutputDir = parser.isSet(outputOption);
+    if (hasOutputDir) {
+        outputDir = QDir(parser.value(outputOption));
+        if (!outputDir.mkpath(outputDir.absolutePath())) {
+            fprintf(stderr, "Failed to create %s\n", qPrintable(outputDir.absolutePath()));
+            return 1;
+        }
+    }
+
+    std::vector<Job> jobs(inputs.count());
+    for (int i=0; i<inputs.count(); i++) {
+        const QFileInfo info(inputs[i]);
+        jobs[i].inputPath = inputs[i];
+        const QString outputName = info.completeBaseName() + ".mem";
+        const QString traceName = info.completeBaseName() + ".trace";
+        if (hasOutputDir) {
+            jobs[i].outputPath = outputDir.filePath(outputName);
+            jobs[i].tracePath = outputDir.filePath(traceName);
+        } else {
+            jobs[i].outputPath = info.absoluteDir().filePath(outputName);
+            jobs[i].tracePath = info.absoluteDir().filePath(traceName);
+        }
+    }
+
+    int threadCount = QThread::idealThreadCount();
+    if (parser.isSet(jobsOption)) {
+        threadCount = parser.value(jobsOption).toInt();
+    }
+    threadCount = qBound(1, threadCount, int(jobs.size()));
+
+    QElapsedTimer totalTimer;
+    totalTimer.start();
+
+    // Files vary a lot in size, so let the threads grab the next one when they're done instead of splitting up front
+    std::atomic<size_t> nextJob(0);
+    std::vector<std::thread> threads;
+    for (int i=0; i<threadCount; i++) {
+        threads.emplace_back([&]() {
+            for (size_t job = nextJob++; job < jobs.size(); job = nextJob++) {
+                assembleFile(cpu, runOptions, &jobs[job]);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    const qint64 totalNsecs = totalTimer.nsecsElapsed();
+
+    int failed = 0;
+    qint64 cpuNsecs = 0;
+    for (const Job &job : jobs) {
+        for (const QString &message : job.messages) {
+            fprintf(stderr, "%s\n", qPrintable(message));
+        }
+        if (!job.ok) {
+            failed++;
+        }
+        cpuNsecs += job.nsecs;
+        printf("%10.3f ms %8d lines %6d bytes  %s%s\n", job.nsecs / 1000000., job.lines, job.bytes, qPrintable(job.inputPath), job.ok ? "" : " (failed)");
+    }
+    printf("%d files, %d failed, %.3f ms total (%.3f ms cpu) on %d threads\n", int(jobs.size()), failed, totalNsecs / 1000000., cpuNsecs / 1000000., threadCount);
+
+    return failed ? 1 : 0;
+}
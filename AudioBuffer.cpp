@@ -3,65 +3,171 @@
 #include <QDebug>
 #include <QFile>
 
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 #include <math.h>
 
-// Start and end with carrier, since soundcards have a tendency to be noisy when starting/stopping
-static constexpr int s_carrierPrefix = 10; // Prefix with 100 bits of carrier tone
-static constexpr int s_carrierSuffix = 10; // End with 100 bits of carrier tone
-
-void AudioBuffer::appendBytes(const QByteArray &bytes)
+int AudioBuffer::appendBytes(const QByteArray &bytes)
 {
-    m_sendBuffer.append(bytes);
-    qDebug() << "Using waveform" << waveform;
+    return int(m_sendQueue.push(reinterpret_cast<const uint8_t*>(bytes.constData()), size_t(bytes.count())));
+}
 
-    const int samplesPerBit = sampleRate / baud; // idklol, i think this is right
-    const int prefixLength = s_carrierPrefix * samplesPerBit;
-    const int suffixLength = s_carrierSuffix * samplesPerBit;
-    const int bitsPerByte = 1 + 8 + 1; // ASCII 8-N-1: 1 start bit, 8 bit data, 1 stop bit
-    QVector<float> newAudio(m_sendBuffer.count() * bitsPerByte * samplesPerBit + prefixLength + suffixLength);
+void AudioBuffer::clear()
+{
+    m_sendQueue.clear();
+    m_bitNum = 0;
+    m_byteLength = 0;
+    m_carrierEnded = true;
+    m_bitFramesLeft = 0;
+    m_bitFrame = 0;
+    m_bitRemainder = 0;
+    m_idle.store(true, std::memory_order_release);
+}
 
-    // We fade in, since that seems to help avoiding the noise from the soundcard
-    qDebug() << "Prefix frame length" << prefixLength << ", audio frames per bit:" << samplesPerBit << ", sample rate:" << sampleRate;
-    qDebug() << "Advance for space:" <<  double(frequency(AnsweringSpace)) / sampleRate << "advance for mark" << double(frequency(AnsweringMark)) / sampleRate;
+const char *AudioBuffer::encodingName(const Encoding encoding)
+{
+    switch(encoding) {
+    case Ascii8N1: return "bell103";
+    case Bell202: return "bell202";
+    case Mfsk4: return "4fsk";
+    case Mfsk8: return "8fsk";
+    case Mfsk16: return "16fsk";
+    default: return "invalid";
+    }
+}
 
-    m_bitNum = 10; // im lazy, > 9 makes advance() take the next byte
+AudioBuffer::Encoding AudioBuffer::encodingFromName(const QString &name)
+{
+    for (int encoding=0; encoding<EncodingCount; encoding++) {
+        if (name == encodingName(Encoding(encoding))) {
+            return Encoding(encoding);
+        }
+    }
+    return EncodingCount;
+}
 
-    printf("Bits: ");
+int AudioBuffer::bitsPerSymbol(const Encoding encoding)
+{
+    switch(encoding) {
+    case Ascii8N1:
+    case Bell202:
+        return 1;
+    case Mfsk4:
+        return 2;
+    case Mfsk8:
+        return 3;
+    case Mfsk16:
+        return 4;
+    default:
+        qWarning() << "Invalid encoding" << encoding;
+        return 1;
+    }
+}
 
-    m_currentTone = AnsweringMark; // Carrier is the mark
-    int position = 0;
-    for (position=0; position<prefixLength; position += samplesPerBit) {
-        generateSound(&newAudio.data()[position], samplesPerBit);
-        printf("%d ", m_currentTone == AnsweringMark ? 1 : 0);
+int64_t AudioBuffer::framesForBytes(const int64_t count) const
+{
+    if (count <= 0) {
+        return 0;
+    }
+    int64_t symbols = count * frameLength(m_encoding);
+    if (hasCarrierPerByte(m_encoding)) {
+        symbols += count * (s_carrierPrefix + s_carrierSuffix);
+    } else {
+        symbols += s_carrierPrefix + s_carrierSuffix;
     }
+    return symbols * sampleRate / baud;
+}
 
-    for (; position<newAudio.size() - suffixLength; position += samplesPerBit) {
-        if (!advance()) {
-            qWarning() << "audio buffer too big" << position;
-            break;
-        }
-        generateSound(&newAudio.data()[position], samplesPerBit);
+int AudioBuffer::highestFrequency() const
+{
+    int highest = 0;
+    for (int symbol=0; symbol<symbolCount(m_encoding); symbol++) {
+        highest = qMax(highest, symbolFrequency(symbol));
+    }
+    return highest;
+}
 
-        printf("%d ", m_currentTone == AnsweringMark ? 1 : 0);
+int AudioBuffer::maxBaud() const
+{
+    // Doesn't make sense with less than four samples per symbol
+    int limit = sampleRate / 4;
+
+    switch(m_encoding) {
+    case Mfsk4:
+    case Mfsk8:
+    case Mfsk16:
+        // The highest tone is this many bauds above the base
+        limit = qMin(limit, ((sampleRate - 1) / 2 - s_multiToneBaseFrequency) / (symbolCount(m_encoding) - 1));
+        break;
+    default:
+        break;
     }
+    return qMax(limit, 0);
+}
+
+namespace {
+
+constexpr int s_phaseFractionBits = AudioBuffer::PhaseFractionBits;
+constexpr uint32_t s_phaseFractionMask = (1u << s_phaseFractionBits) - 1;
+constexpr float s_phaseFractionScale = 1.f / (1u << s_phaseFractionBits);
+
+#if defined(__GNUC__)
+// Lets the compiler pick the instructions, so it works with SSE2, AVX2, NEON
+// or whatever the target has.
+#if defined(__AVX2__)
+constexpr int s_laneCount = 8;
+#else
+constexpr int s_laneCount = 4;
+#endif
+typedef uint32_t PhaseLanes __attribute__((vector_size(s_laneCount * 4)));
+typedef int32_t IntLanes __attribute__((vector_size(s_laneCount * 4)));
+typedef float SampleLanes __attribute__((vector_size(s_laneCount * 4)));
+#endif
 
-    m_currentTone = AnsweringMark; // Keep some carrier, less abrupt end
+// Interpolates frames samples out of the wavetable, returns the phase after
+// the last one. Several frames are done at once with SIMD, only the table
+// lookups are done one lane at a time.
+uint32_t synthesize(const float *samples, uint32_t phase, const uint32_t increment, const float gain, float *output, const size_t frames)
+{
+    size_t i = 0;
 
-    for (int it=samplesPerBit; position<newAudio.size(); position += samplesPerBit, it += samplesPerBit) {
-        generateSound(&newAudio.data()[position], samplesPerBit);
-        printf("%d ", m_currentTone == AnsweringMark ? 1 : 0);
+#if defined(__GNUC__)
+    PhaseLanes phases;
+    for (int lane=0; lane<s_laneCount; lane++) {
+        phases[lane] = phase + increment * uint32_t(lane);
     }
-    puts("");
+    const PhaseLanes step = PhaseLanes{} + increment * uint32_t(s_laneCount);
+
+    for (; i + s_laneCount <= frames; i += s_laneCount) {
+        const PhaseLanes index = phases >> s_phaseFractionBits;
 
-    m_audio.append(newAudio);
+        // The fraction is small enough for a signed conversion, which SSE2 has
+        const SampleLanes fraction = __builtin_convertvector((IntLanes)(phases & s_phaseFractionMask), SampleLanes) * s_phaseFractionScale;
 
-    if (!m_sendBuffer.isEmpty()) {
-        qWarning() << "Audio buffer too small";
-        qDebug() << m_sendBuffer.size() << m_audio.size();
+        SampleLanes current, next;
+        for (int lane=0; lane<s_laneCount; lane++) {
+            current[lane] = samples[index[lane]];
+            next[lane] = samples[index[lane] + 1];
+        }
+
+        const SampleLanes result = (current + (next - current) * fraction) * gain;
+        memcpy(output + i, &result, sizeof result);
+        phases += step;
     }
+    phase = phases[0];
+#endif
 
-    saveWavFile("test.wav");
+    // The rest (or everything, without vector support)
+    for (; i<frames; i++) {
+        const uint32_t index = phase >> s_phaseFractionBits;
+        const float fraction = float(phase & s_phaseFractionMask) * s_phaseFractionScale;
+        output[i] = (samples[index] + (samples[index + 1] - samples[index]) * fraction) * gain;
+        phase += increment;
+    }
+    return phase;
 }
+} // namespace
 
 namespace {
     struct WavHeader {
@@ -117,21 +223,21 @@ namespace {
                 subchunk2Size;
         };
 
-        template<typename BufferType>
-        void finalize(const BufferType &buffer) {
+        template<typename SampleType>
+        void finalize(const uint32_t frameCount) {
             Q_ASSERT(sampleRate > 0);
             Q_ASSERT(numChannels > 0);
-            Q_ASSERT(buffer.size() > 0);
+            Q_ASSERT(frameCount > 0);
 
-            if (std::is_floating_point<typename BufferType::value_type>::value) {
+            if (std::is_floating_point<SampleType>::value) {
                 audioFormat = WavHeader::IEEEFloat;
             } else {
                 audioFormat = WavHeader::PCM;
             }
-            bitsPerSample = sizeof(typename BufferType::value_type) * 8;
+            bitsPerSample = sizeof(SampleType) * 8;
             byteRate = sampleRate * numChannels * (bitsPerSample / 8);
             blockAlign = numChannels * (bitsPerSample / 8);
-            subchunk2Size = buffer.size() * numChannels * (bitsPerSample / 8);
+            subchunk2Size = frameCount * numChannels * (bitsPerSample / 8);
 
             chunkSize = sizeof(format) +
                 (sizeof(subchunk1ID) + sizeof(subchunk1Size) + subchunk1Size) +
@@ -140,13 +246,14 @@ namespace {
     };
 } // namespace
 
-bool AudioBuffer::saveWavFile(const QString &filename)
+bool AudioBuffer::saveWavFile(const QString &filename, const QByteArray &bytes) const
 {
 #if Q_BYTE_ORDER == Q_BIG_ENDIAN
 #error "I can't be bothered to support big endian"
 #endif
 
-    if (m_audio.isEmpty()) {
+    const int64_t frames = framesForBytes(bytes.count());
+    if (frames <= 0 || frames > int64_t(UINT32_MAX / sizeof(float))) {
         qWarning() << "No audio to save";
         return false;
     }
@@ -159,7 +266,7 @@ bool AudioBuffer::saveWavFile(const QString &filename)
     WavHeader header;
     header.numChannels = channels;
     header.sampleRate = sampleRate;
-    header.finalize(m_audio);
+    header.finalize<float>(frames);
 
     Q_ASSERT(*(const uint32_t*)(header.chunkID) == 0x46464952);
     Q_ASSERT(*(const uint32_t*)(header.subchunk1ID) == 0x20746d66);
@@ -169,108 +276,303 @@ bool AudioBuffer::saveWavFile(const QString &filename)
     Q_ASSERT(header.isValid());
 
     file.write(reinterpret_cast<const char*>(&header), sizeof(WavHeader));
-    file.write(reinterpret_cast<const char*>(m_audio.data()), m_audio.size() * sizeof(decltype(m_audio)::value_type));
+
+    // Generate it in chunks, so we don't need the whole thing in memory
+    AudioBuffer renderer;
+    renderer.m_encoding = m_encoding;
+    renderer.waveform = waveform;
+    renderer.channels = channels;
+    renderer.sampleRate = sampleRate;
+    renderer.baud = baud;
+    renderer.spaceFrequency = spaceFrequency;
+    renderer.markFrequency = markFrequency;
+    renderer.volume = volume;
+    renderer.prepare();
+
+    int queued = 0;
+    float chunk[4096];
+    for (int64_t written = 0; written < frames; written += int64_t(std::size(chunk))) {
+        queued += renderer.appendBytes(QByteArray::fromRawData(bytes.constData() + queued, bytes.count() - queued));
+
+        const uint32_t count = uint32_t(qMin<int64_t>(std::size(chunk), frames - written));
+        renderer.takeFrames(count, chunk);
+        file.write(reinterpret_cast<const char*>(chunk), count * sizeof(float));
+    }
 
     return true;
 }
 
 #define TWO_PI (M_PI * 2.)
 
-void AudioBuffer::generateSound(float *output, size_t frames)
+void AudioBuffer::updateWavetable(const Tone tone)
 {
-    if (m_currentTone == Silence) {
-        for (size_t i=0; i<frames; i++) {
-            output[i] = 0;
-        }
+    Wavetable &table = m_wavetables[tone];
+    const int freq = frequency(tone);
+    if (table.frequency == freq && table.sampleRate == sampleRate && table.waveform == waveform) {
         return;
     }
-    const int freq = frequency(m_currentTone);
-    if (!freq || ! sampleRate) {
+    table.frequency = freq;
+    table.sampleRate = sampleRate;
+    table.waveform = waveform;
+
+    if (freq <= 0 || sampleRate <= 0) {
         qWarning() << "missing frequency or sample rate" << freq << sampleRate;
+        table.increment = 0;
+        std::fill(std::begin(table.samples), std::end(table.samples), 0.f);
         return;
     }
-    const double advance = double(freq) / sampleRate;
-    switch(waveform) {
-    case Sine:
-        for (size_t i=0; i<frames; i++, m_time += advance) {
-            output[i] = sin(TWO_PI * m_time) * volume;
+    table.increment = uint32_t(std::llround(fmod(double(freq) / sampleRate, 1.) * 4294967296.));
+
+    // Fourier series of the same shapes as the naive versions, cut off at
+    // half the sample rate
+    int harmonics = 0;
+    while (2 * (harmonics + 1) * int64_t(freq) < sampleRate) {
+        harmonics++;
+    }
+    if (waveform == Sine) {
+        harmonics = qMin(harmonics, 1);
+    }
+
+    for (int i=0; i<=s_tableSize; i++) {
+        const double x = TWO_PI * i / s_tableSize;
+        double value = 0.;
+        switch(waveform) {
+        case Sine:
+            value = harmonics ? sin(x) : 0.;
+            break;
+        case Sawtooth: // rising from -1 to 1
+            for (int k=1; k<=harmonics; k++) {
+                value -= sin(k * x) / k;
+            }
+            value *= 2. / M_PI;
+            break;
+        case Triangle: // starts at 1, -1 halfway through
+            for (int k=1; k<=harmonics; k+=2) {
+                value += cos(k * x) / (k * k);
+            }
+            value *= 8. / (M_PI * M_PI);
+            break;
+        case Square: // 1 for the first half, -1 for the second
+            for (int k=1; k<=harmonics; k+=2) {
+                value += sin(k * x) / k;
+            }
+            value *= 4. / M_PI;
+            break;
+        default:
+            assert(false);
+            break;
         }
-        break;
-    case Sawtooth:
-        for (size_t i=0; i<frames; i++, m_time += advance) {
-            output[i] = 2 * ((m_time - int64_t(m_time)) - 0.5) * volume;
+        table.samples[i] = float(value);
+    }
+
+    // A cut off series rings around the jumps (Gibbs), so square and
+    // sawtooth would go about 9% past full scale at full volume
+    float peak = 0.f;
+    for (const float sample : table.samples) {
+        peak = qMax(peak, fabsf(sample));
+    }
+    if (peak > 0.f) {
+        for (float &sample : table.samples) {
+            sample /= peak;
         }
-        break;
-    case Triangle:
-        for (size_t i=0; i<frames; i++, m_time += advance) {
-            output[i] = (2 * std::abs(2 * ((m_time - int64_t(m_time)) - 0.5)) - 1) * volume;
+    }
+}
+
+bool AudioBuffer::SymbolSettings::operator==(const SymbolSettings &other) const
+{
+    return encoding == other.encoding &&
+        waveform == other.waveform &&
+        sampleRate == other.sampleRate &&
+        baud == other.baud &&
+        spaceFrequency == other.spaceFrequency &&
+        markFrequency == other.markFrequency &&
+        volume == other.volume;
+}
+
+AudioBuffer::SymbolSettings AudioBuffer::currentSymbolSettings() const
+{
+    SymbolSettings settings;
+    settings.encoding = m_encoding;
+    settings.waveform = waveform;
+    settings.sampleRate = sampleRate;
+    settings.baud = baud;
+    settings.spaceFrequency = spaceFrequency;
+    settings.markFrequency = markFrequency;
+    settings.volume = volume;
+    return settings;
+}
+
+void AudioBuffer::prepare()
+{
+    const SymbolSettings settings = currentSymbolSettings();
+    if (settings == m_symbolSettings) {
+        return;
+    }
+    m_symbolSettings = settings;
+    m_currentSymbol = nullptr;
+    for (QVector<float> &symbols : m_symbols) {
+        symbols = QVector<float>();
+    }
+
+    if (baud <= 0 || sampleRate <= 0) {
+        m_symbolLength = 0;
+        return;
+    }
+    m_symbolLength = (sampleRate + baud - 1) / baud;
+    m_bitLength = sampleRate / baud;
+    m_bitLengthRemainder = sampleRate % baud;
+
+    const int symbolCount = AudioBuffer::symbolCount(m_encoding);
+    m_carrierSymbol = symbolCount - 1;
+    m_bitsPerSymbol = bitsPerSymbol(m_encoding);
+    m_frameLength = frameLength(m_encoding);
+
+    // So the audio callback never has to build them, even without templates
+    for (int symbol=0; symbol<symbolCount; symbol++) {
+        m_symbolTones[symbol] = toneForSymbol(m_encoding, symbol);
+        updateWavetable(m_symbolTones[symbol]);
+    }
+    if (m_bitLength < s_minSymbolTemplateLength) {
+        return;
+    }
+    if (int64_t(symbolCount) * s_phaseBuckets * m_symbolLength * int64_t(sizeof(float)) > s_maxSymbolTemplateBytes) {
+        return;
+    }
+
+    for (int symbol=0; symbol<symbolCount; symbol++) {
+        const Tone tone = m_symbolTones[symbol];
+        const Wavetable &table = m_wavetables[tone];
+
+        QVector<float> &symbols = m_symbols[tone];
+        symbols.resize(s_phaseBuckets * m_symbolLength);
+        for (int bucket=0; bucket<s_phaseBuckets; bucket++) {
+            const uint32_t phase = uint32_t(bucket) << (32 - s_phaseBucketBits);
+            synthesize(table.samples, phase, table.increment, volume, symbols.data() + bucket * m_symbolLength, m_symbolLength);
         }
-        break;
-    case Square:
+    }
+}
+
+void AudioBuffer::generateSound(float *output, size_t frames)
+{
+    if (m_currentTone == Silence) {
         for (size_t i=0; i<frames; i++) {
-            if (m_time - int64_t(m_time) < 0.5) {
-                output[i] = volume;
-            } else {
-                output[i] = -volume;
-            }
-            m_time += advance;
+            output[i] = 0;
         }
-        break;
+        return;
+    }
+
+    const Wavetable &table = m_wavetables[m_currentTone];
+    if (m_currentSymbol) {
+        memcpy(output, m_currentSymbol + m_bitFrame, frames * sizeof(float));
+        m_phase += table.increment * uint32_t(frames);
+    } else {
+        m_phase = synthesize(table.samples, m_phase, table.increment, m_symbolSettings.volume, output, frames);
+    }
+}
+
+AudioBuffer::Tone AudioBuffer::toneForSymbol(const Encoding encoding, const int symbol)
+{
+    switch(encoding) {
+    case Ascii8N1:
+        return symbol ? AnsweringMark : AnsweringSpace;
+    case Bell202:
+        return symbol ? Bell202Mark : Bell202Space;
+    case Mfsk4:
+    case Mfsk8:
+    case Mfsk16:
+        return Tone(MultiTone + qBound(0, symbol, s_maxSymbolCount - 1));
     default:
-        assert(false);
-        break;
+        qWarning() << "Invalid encoding";
+        return AnsweringMark;
     }
 }
 
+AudioBuffer::Tone AudioBuffer::toneForBit(const int bitNum) const
+{
+    const int symbol = bitNum - m_carrierBefore;
+    if (symbol <= 0 || symbol >= m_frameLength - 1) {
+        return m_symbolTones[symbol == 0 ? 0 : m_carrierSymbol]; // start bit, otherwise carrier or stop bit
+    }
+    return m_symbolTones[(m_currentByte >> ((symbol - 1) * m_bitsPerSymbol)) & m_carrierSymbol];
+}
+
 bool AudioBuffer::advance()
 {
-    if (m_bitNum > 9) {
-        if (m_sendBuffer.isEmpty()) {
-            qDebug() << "Finito";
+    if (m_symbolLength <= 0) {
+        return false; // not prepared
+    }
+
+    if (m_bitNum >= m_byteLength) {
+        const bool perByte = hasCarrierPerByte(m_symbolSettings.encoding);
+        // Before the queue can look empty, see isFinished()
+        m_idle.store(false, std::memory_order_release);
+        if (m_sendQueue.pop(&m_currentByte)) {
+            // Straight on to the next byte if we're still sending
+            m_carrierBefore = m_carrierEnded ? s_carrierPrefix : 0;
+            m_byteLength = m_carrierBefore + m_frameLength;
+            if (perByte) {
+                m_byteLength += s_carrierSuffix;
+            }
+            m_carrierEnded = perByte;
+            m_bitNum = 0;
+        } else if (!m_carrierEnded) {
+            // Ran out, finish off with some carrier
+            m_byteLength += s_carrierSuffix;
+            m_carrierEnded = true;
+        } else {
             return false;
         }
+    }
 
-        m_currentByte = m_sendBuffer[0];
-        m_sendBuffer.remove(0, 1);
-        m_bitNum = 0;
+    m_currentTone = toneForBit(m_bitNum);
+    m_bitNum++;
+    m_bitFramesLeft = takeBitLength();
+    m_bitFrame = 0;
+
+    // Copy from the symbol starting closest to where we are
+    if (!m_symbols[m_currentTone].isEmpty()) {
+        const uint32_t bucket = (m_phase + (1u << (31 - s_phaseBucketBits))) >> (32 - s_phaseBucketBits);
+        m_currentSymbol = m_symbols[m_currentTone].constData() + bucket * m_symbolLength;
+        return true;
     }
 
-    if (m_bitNum > 8) {
-        switch(m_encoding) {
-        case Ascii8N1:
-            m_currentTone = AnsweringMark;
-            break;
-        default:
-            qWarning() << "Invalid encoding";
-            m_currentTone = AnsweringMark;
-            break;
-        }
-    } else if (m_bitNum == 0) {
-        switch(m_encoding) {
-        case Ascii8N1:
-            m_currentTone = AnsweringSpace;
-            break;
-        default:
-            qWarning() << "Invalid encoding";
-            m_currentTone = AnsweringSpace;
-            break;
-        }
-    } else {
-        m_currentTone = (m_currentByte >> (m_bitNum - 1)) & 0b1 ? AnsweringMark : AnsweringSpace;
+    // Otherwise take all the following bits with the same tone too, so
+    // they're generated in one go
+    m_currentSymbol = nullptr;
+    while (m_bitNum < m_byteLength && toneForBit(m_bitNum) == m_currentTone) {
+        m_bitNum++;
+        m_bitFramesLeft += takeBitLength();
     }
-    //qDebug() << m_sendBuffer.count() << m_bitNum << m_currentTone;
-    m_bitNum++;
     return true;
 }
 
-void AudioBuffer::takeFrames(uint32_t frameCount, void *output)
+int AudioBuffer::takeBitLength()
 {
-    const size_t byteCount = sizeof(decltype(m_audio)::value_type) * frameCount;
-    memset(output, '\0', byteCount); // could Optimize™ and only zero the frames at the end, but idc
-    if (frameCount > m_audio.size()) {
-        frameCount = m_audio.size();
+    // Carry the fraction over, so the bits stay in time whatever the baud
+    int length = m_bitLength;
+    m_bitRemainder += m_bitLengthRemainder;
+    if (m_bitRemainder >= m_symbolSettings.baud) {
+        m_bitRemainder -= m_symbolSettings.baud;
+        length++;
     }
+    return length;
+}
 
-    memcpy(output, m_audio.data(), byteCount);
-    m_audio.remove(0, frameCount);
+void AudioBuffer::takeFrames(uint32_t frameCount, void *output)
+{
+    float *frames = reinterpret_cast<float*>(output);
+    while (frameCount > 0) {
+        if (m_bitFramesLeft <= 0 && !advance()) {
+            memset(frames, '\0', frameCount * sizeof(float)); // nothing more to send, silence
+            break;
+        }
+        const uint32_t count = qMin(frameCount, uint32_t(m_bitFramesLeft));
+        generateSound(frames, count);
+        frames += count;
+        frameCount -= count;
+        m_bitFramesLeft -= count;
+        m_bitFrame += count;
+        m_framesPlayed.fetch_add(count, std::memory_order_relaxed);
+    }
+    m_idle.store(isEmpty(), std::memory_order_release);
 }
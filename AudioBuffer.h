@@ -1,17 +1,40 @@
 #pragma once
 
-#include <QVector>
+#include "RingBuffer.h"
+
+#include <QString>
 #include <QByteArray>
+#include <QVector>
 
+#include <atomic>
 #include <cstddef>
+#include <memory>
 
 struct AudioBuffer
 {
+    // All of them send each byte like a UART: a start symbol, the data
+    // symbols (least significant bits first) and a stop symbol. The highest
+    // symbol is the carrier and stop, and 0 is the start.
     enum Encoding {
-        // Just one for now, hardcoded start/stop bits
-        Ascii8N1
+        Ascii8N1, // Bell 103-ish with the configured frequencies, carrier around every byte
+        Bell202, // 1200 and 2200 Hz
+        Mfsk4, // Multiple frequency-shift keying, the tones are a baud apart so
+        Mfsk8, // they don't leak into each other within a symbol
+        Mfsk16,
+        EncodingCount
     };
     Encoding m_encoding = Ascii8N1;
+
+    // For the command line, EncodingCount if there's no such encoding
+    static const char *encodingName(const Encoding encoding);
+    static Encoding encodingFromName(const QString &name);
+    static int bitsPerSymbol(const Encoding encoding);
+    static int symbolCount(const Encoding encoding) { return 1 << bitsPerSymbol(encoding); }
+    static int dataSymbols(const Encoding encoding) { return (8 + bitsPerSymbol(encoding) - 1) / bitsPerSymbol(encoding); }
+    // Ascii8N1 has carrier before and after every byte (which the hardware
+    // relies on), the others only around each transmission
+    static bool hasCarrierPerByte(const Encoding encoding) { return encoding == Ascii8N1; }
+
     enum Waveform {
         Invalid = -1,
         Square,
@@ -22,12 +45,38 @@ struct AudioBuffer
     };
     Waveform waveform = Triangle;
 
-    int frameCount() const { return m_audio.size(); }
+    // Audio is generated on the fly from the queued bytes when it's taken,
+    // so nothing is rendered up front no matter how much is queued.
+    //
+    // The bytes go through a lock free queue, so one thread (the GUI) can
+    // append while another (the audio callback) takes frames without either
+    // of them ever waiting for the other.
+
+    // Producer side, returns how many bytes fit in the queue
+    int appendBytes(const QByteArray &bytes);
+    // All of it has been played, and nothing more is queued. Checks the
+    // queue first, advance() clears m_idle before it pops a byte, so an
+    // empty queue with m_idle set means that byte is done too.
+    bool isFinished() const { return m_sendQueue.isEmpty() && m_idle.load(std::memory_order_acquire); }
+    int64_t framesPlayed() const { return m_framesPlayed.load(std::memory_order_relaxed); }
+    int64_t framesForBytes(const int64_t count) const;
+
+    // Takes a copy of the settings for the consumer side, which never looks
+    // at anything else, and precomputes the wavetables and symbols, so
+    // sending is mostly copying. Has to be called before taking frames, and
+    // changed settings only take effect when it's called again. Allocates,
+    // so only when nothing is taking frames.
+    void prepare();
+
+    // Consumer side, pads with silence when there's nothing to send
     void takeFrames(uint32_t frameCount, void *output);
-    bool isEmpty() const { return m_audio.isEmpty(); }
-    void appendBytes(const QByteArray &bytes);
-    bool saveWavFile(const QString &filename);
-    void clear() { m_audio.clear(); }
+    bool isEmpty() const { return m_sendQueue.isEmpty() && m_bitNum >= m_byteLength && m_bitFramesLeft <= 0 && m_carrierEnded; }
+
+    // Only when nothing is taking frames
+    void clear();
+
+    // Renders what the bytes would sound like with the current settings
+    bool saveWavFile(const QString &filename, const QByteArray &bytes) const;
 
     int channels = 1;
     int sampleRate = 44100;
@@ -38,35 +87,143 @@ struct AudioBuffer
 
     float volume = 0.1;
 
+    // What's actually sent for each symbol with the current encoding, for the demodulator
+    int symbolFrequency(const int symbol) const { return frequency(toneForSymbol(m_encoding, symbol)); }
+
+    // Anything at or above half the sample rate can't be played, and would
+    // come out as silence
+    int highestFrequency() const;
+    bool tonesFitSampleRate() const { return 2 * int64_t(highestFrequency()) < sampleRate; }
+    // With the current encoding and sample rate, the MFSK tones go up with the baud
+    int maxBaud() const;
+
+    // The MFSK tones start here
+    static constexpr int s_multiToneBaseFrequency = 1000;
+
+    // Bits of the phase below the wavetable index
+    static constexpr int PhaseFractionBits = 21;
+
 private:
+    static constexpr int s_maxSymbolCount = 16;
+
     enum Tone {
         OriginatingMark,
         OriginatingSpace,
         AnsweringMark,
         AnsweringSpace,
+        Bell202Mark,
+        Bell202Space,
         Silence,
-        ToneCount
+        MultiTone, // first of the MFSK ones, one for each symbol
+        ToneCount = MultiTone + s_maxSymbolCount
     };
 
-    inline int frequency(const Tone tone) {
+    inline int frequency(const Tone tone) const {
         switch(tone) {
         case Tone::OriginatingMark: return 1270;
         case Tone::OriginatingSpace: return 1070;
         case Tone::AnsweringMark: return spaceFrequency;//2225;
         case Tone::AnsweringSpace: return markFrequency;//2025;
-        default: return 1270; // Mark default when no signal
+        case Tone::Bell202Mark: return 1200;
+        case Tone::Bell202Space: return 2200;
+        default:
+            if (tone >= MultiTone && tone < ToneCount) {
+                return s_multiToneBaseFrequency + (tone - MultiTone) * baud;
+            }
+            return 1270; // Mark default when no signal
         }
     }
 
+    // Carrier before and after, since soundcards have a tendency to be
+    // noisy when starting/stopping
+    static constexpr int s_carrierPrefix = 10;
+    static constexpr int s_carrierSuffix = 10;
+    // Start symbol, data and stop symbol
+    static int frameLength(const Encoding encoding) { return 1 + dataSymbols(encoding) + 1; }
+
+    // Wavetable oscillator: the phase is a 32 bit fixed point fraction of a
+    // period that just wraps around, so it never drifts, and each tone has a
+    // table with only the harmonics below half the sample rate, so there's no
+    // aliasing. Generating a sample is a lookup and a linear interpolation.
+    static constexpr int s_tableBits = 32 - PhaseFractionBits;
+    static constexpr int s_tableSize = 1 << s_tableBits;
+
+    struct Wavetable
+    {
+        // Rebuilt when these change
+        int frequency = 0;
+        int sampleRate = 0;
+        Waveform waveform = Invalid;
+
+        uint32_t increment = 0; // phase per frame
+        float samples[s_tableSize + 1] = {}; // last one is the first repeated, for interpolating
+    };
+
+    void updateWavetable(const Tone tone);
+
+    // What prepare() was called with, the consumer side only goes by these
+    struct SymbolSettings
+    {
+        Encoding encoding = EncodingCount;
+        Waveform waveform = Invalid;
+        int sampleRate = 0;
+        int baud = 0;
+        int spaceFrequency = 0;
+        int markFrequency = 0;
+        float volume = 0.f;
+
+        bool operator==(const SymbolSettings &other) const;
+        bool operator!=(const SymbolSettings &other) const { return !(*this == other); }
+    };
+    SymbolSettings currentSymbolSettings() const;
+
+    // One bit of each tone starting at each of these phases, the one closest
+    // to the actual phase is used. The actual phase is still kept exactly,
+    // so being off by a bucket never adds up.
+    static constexpr int s_phaseBucketBits = 8;
+    static constexpr int s_phaseBuckets = 1 << s_phaseBucketBits;
+    // With many tones and a low baud it gets big, then we just generate them
+    static constexpr int64_t s_maxSymbolTemplateBytes = 8 << 20;
+    // Copying a very short symbol isn't any faster than generating it, and
+    // generating can do several bits with the same tone at once
+    static constexpr int s_minSymbolTemplateLength = 16;
+
+    static Tone toneForSymbol(const Encoding encoding, const int symbol);
+    Tone toneForBit(const int bitNum) const;
     bool advance();
+    int takeBitLength();
     void generateSound(float *output, size_t frames);
 
-    double m_time = 0.; // idk should do math so it doesn't wrap randomly
-    QByteArray m_sendBuffer;
+    uint32_t m_phase = 0; // fraction of a period, continuous between tones
+    std::unique_ptr<Wavetable[]> m_wavetables{new Wavetable[ToneCount]}; // too big for the stack
+
+    SymbolSettings m_symbolSettings;
+    int m_symbolLength = 0; // longest a bit can be
+
+    // Worked out from the settings by prepare(), so there's as little as
+    // possible to do for each bit
+    Tone m_symbolTones[s_maxSymbolCount] = {};
+    int m_carrierSymbol = 0; // also the mask for one symbol
+    int m_bitsPerSymbol = 1;
+    int m_frameLength = 0;
+    int m_bitLength = 0; // in frames, rounded down
+    int m_bitLengthRemainder = 0;
+    QVector<float> m_symbols[ToneCount]; // s_phaseBuckets * m_symbolLength, only the tones of the current encoding
+    const float *m_currentSymbol = nullptr; // or nullptr to generate the samples
+    RingBuffer<uint8_t> m_sendQueue{4096};
+    std::atomic<bool> m_idle{true};
+    std::atomic<int64_t> m_framesPlayed{0};
     uint8_t m_currentByte = 0;
-    uint8_t m_bitNum = 0;
+    // Symbols of the current byte, including the carrier before and after.
+    // The carrier after is only added when there's nothing more to send
+    // right away, unless there's carrier around every byte.
+    int m_bitNum = 0; // >= m_byteLength makes advance() take the next byte
+    int m_byteLength = 0;
+    int m_carrierBefore = 0;
+    bool m_carrierEnded = true; // so the next byte starts with carrier again
+    int m_bitFramesLeft = 0; // of the current bit, or run of bits with the same tone when generating
+    int m_bitFrame = 0; // how far into the current bit we are, when copying
+    int m_bitRemainder = 0; // sampleRate / baud is rarely whole, so some bits are a frame longer
 
     Tone m_currentTone = Silence;
-
-    QVector<float> m_audio;
 };
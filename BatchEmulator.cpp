@@ -0,0 +1,254 @@
+#include "BatchEmulator.h"
+#include "SimdEmulator.h"
+
+#include <QThread>
+
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+BatchEmulator::BatchEmulator(const CPU &cpu) :
+    m_emulator(cpu)
+{
+    for (int opcode=0; opcode<256; opcode++) {
+        m_operations[opcode] = m_emulator.operation(opcode);
+    }
+    m_addressMask = m_emulator.addressMask();
+    m_pcIncrement = m_emulator.instructionSize();
+    m_cyclesPerInstruction = m_emulator.cyclesPerInstruction();
+    m_simdSupported = SimdEmulator::isSupported(m_emulator);
+}
+
+QByteArray BatchEmulator::memoryFromImage(const MemoryImage &image, const int size)
+{
+    QByteArray memory(size, '\0');
+    for (uint32_t address = image.first(); address < uint32_t(size); address = image.next(address)) {
+        memory[address] = char(image.value(address));
+    }
+    return memory;
+}
+
+QVector<BatchEmulator::Result> BatchEmulator::run(const QVector<QByteArray> &memories, const uint64_t maxInstructions, int threadCount)
+{
+    const int machineCount = memories.count();
+    QVector<Result> results(machineCount);
+    if (machineCount == 0) {
+        return results;
+    }
+
+    const SimdEmulator simd(m_emulator);
+    const bool useSimd = isSimdActive();
+
+    // The SIMD one works straight from the memories, only the scalar one
+    // needs its own copy of everything
+    Machines machines;
+    if (!useSimd) {
+        machines.a.fill(0, machineCount);
+        machines.b.fill(0, machineCount);
+        machines.pc.fill(0, machineCount);
+        machines.sp.fill(0, machineCount);
+        machines.carry.fill(0, machineCount);
+        machines.zero.fill(0, machineCount);
+        machines.instructions.fill(0, machineCount);
+        machines.memory.fill(0, machineCount * Stride);
+        machines.stack.fill(0, machineCount * Stride);
+
+        uint8_t *memory = machines.memory.data();
+        for (int i=0; i<machineCount; i++) {
+            memcpy(memory + i * Stride, memories[i].constData(), qMin(memories[i].size(), memorySize()));
+        }
+    }
+
+    const int chunkCount = (machineCount + ChunkSize - 1) / ChunkSize;
+    if (threadCount <= 0) {
+        threadCount = QThread::idealThreadCount();
+    }
+    threadCount = qBound(1, threadCount, chunkCount);
+
+    // Everyone starts with their own contiguous range of chunks, and steals
+    // from the back of the others when they run out (some programs halt
+    // right away, others run until the limit).
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<int> chunks;
+    };
+    std::vector<Queue> queues(threadCount);
+    for (int chunk=0; chunk<chunkCount; chunk++) {
+        queues[qint64(chunk) * threadCount / chunkCount].chunks.push_back(chunk);
+    }
+
+    auto takeChunk = [&](const int worker, int *chunk) {
+        for (int i=0; i<threadCount; i++) {
+            Queue &queue = queues[(worker + i) % threadCount];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.chunks.empty()) {
+                continue;
+            }
+            if (i == 0) {
+                *chunk = queue.chunks.front();
+                queue.chunks.pop_front();
+            } else {
+                *chunk = queue.chunks.back();
+                queue.chunks.pop_back();
+            }
+            return true;
+        }
+        return false;
+    };
+
+    auto work = [&](const int worker) {
+        int chunk = 0;
+        while (takeChunk(worker, &chunk)) {
+            const int first = chunk * ChunkSize;
+            const int count = qMin(ChunkSize, machineCount - first);
+            if (!useSimd) {
+                runChunk(&machines, &results, first, count, maxInstructions);
+                continue;
+            }
+            for (int group=first; group<first + count; group += SimdEmulator::laneCount()) {
+                simd.run(memories.constData() + group, results.data() + group, qMin(SimdEmulator::laneCount(), first + count - group), maxInstructions);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int worker=1; worker<threadCount; worker++) {
+        threads.emplace_back(work, worker);
+    }
+    work(0);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    return results;
+}
+
+void BatchEmulator::runChunk(Machines *machines, QVector<Result> *results, const int first, const int count, const uint64_t maxInstructions) const
+{
+    uint8_t *a = machines->a.data();
+    uint8_t *b = machines->b.data();
+    uint8_t *pc = machines->pc.data();
+    uint8_t *sp = machines->sp.data();
+    uint8_t *carry = machines->carry.data();
+    uint8_t *zero = machines->zero.data();
+    uint64_t *instructions = machines->instructions.data();
+    uint8_t *memories = machines->memory.data();
+    uint8_t *stacks = machines->stack.data();
+    Result *result = results->data();
+
+    // Same as the ALU on the breadboard, subtraction is adding the two's complement
+    auto calculate = [=](const int machine, const uint8_t value, const bool subtract) {
+        b[machine] = value;
+        const int sum = subtract ? a[machine] + uint8_t(~value) + 1 : a[machine] + value;
+        carry[machine] = sum > 0xFF;
+        a[machine] = uint8_t(sum);
+        zero[machine] = a[machine] == 0;
+    };
+
+    // The ones that are still running, kept packed so we don't have to skip over the others
+    int active[ChunkSize];
+    int activeCount = 0;
+    for (int i=0; i<count; i++) {
+        active[activeCount++] = first + i;
+    }
+
+    for (uint64_t step=0; step<maxInstructions && activeCount > 0; step++) {
+        int kept = 0;
+        for (int i=0; i<activeCount; i++) {
+            const int machine = active[i];
+            uint8_t *memory = memories + machine * Stride;
+            uint8_t *stack = stacks + machine * Stride;
+
+            const uint8_t address = pc[machine];
+            uint8_t opcode, operand;
+            if (m_pcIncrement == 1) {
+                opcode = memory[address] >> 4;
+                operand = memory[address] & 0xF;
+            } else {
+                opcode = memory[address];
+                operand = memory[(address + 1) & m_addressMask];
+            }
+
+            const Emulator::Operation operation = m_operations[opcode];
+            if (operation == Emulator::Operation::Invalid) {
+                result[machine].reason = Emulator::InvalidOpcode;
+                continue;
+            }
+            pc[machine] = (address + m_pcIncrement) & m_addressMask;
+            instructions[machine]++;
+
+            switch(operation) {
+            case Emulator::Operation::Invalid:
+            case Emulator::Operation::Decode:
+            case Emulator::Operation::Nop:
+                break;
+            case Emulator::Operation::Lda:
+                a[machine] = memory[operand];
+                break;
+            case Emulator::Operation::Add:
+                calculate(machine, memory[operand], false);
+                break;
+            case Emulator::Operation::Sub:
+                calculate(machine, memory[operand], true);
+                break;
+            case Emulator::Operation::Addi:
+                calculate(machine, operand, false);
+                break;
+            case Emulator::Operation::Subi:
+                calculate(machine, operand, true);
+                break;
+            case Emulator::Operation::Sta:
+                memory[operand] = a[machine];
+                break;
+            case Emulator::Operation::Ldi:
+                a[machine] = operand;
+                break;
+            case Emulator::Operation::Jmp:
+                pc[machine] = operand;
+                break;
+            case Emulator::Operation::Jc:
+                if (carry[machine]) {
+                    pc[machine] = operand;
+                }
+                break;
+            case Emulator::Operation::Jz:
+                if (zero[machine]) {
+                    pc[machine] = operand;
+                }
+                break;
+            case Emulator::Operation::Out:
+                result[machine].outputs.append({instructions[machine] * m_cyclesPerInstruction, a[machine]});
+                break;
+            case Emulator::Operation::Hlt:
+                result[machine].reason = Emulator::Halted;
+                continue;
+            case Emulator::Operation::Psh:
+                stack[--sp[machine]] = a[machine];
+                break;
+            case Emulator::Operation::Pop:
+                a[machine] = stack[sp[machine]++];
+                break;
+            case Emulator::Operation::Jsr:
+                stack[--sp[machine]] = pc[machine];
+                pc[machine] = operand;
+                break;
+            case Emulator::Operation::Rts:
+                pc[machine] = stack[sp[machine]++] & m_addressMask;
+                break;
+            }
+
+            active[kept++] = machine;
+        }
+        activeCount = kept;
+    }
+
+    for (int machine=first; machine<first + count; machine++) {
+        result[machine].instructions = instructions[machine];
+        result[machine].cycles = instructions[machine] * m_cyclesPerInstruction;
+        result[machine].a = a[machine];
+        result[machine].pc = pc[machine];
+    }
+}
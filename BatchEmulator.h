@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Emulator.h"
+
+#include <QByteArray>
+#include <QVector>
+
+// Runs lots of machines at once, e.g. the same program with different data,
+// spread over all cores.
+//
+// The state of all machines is kept as a struct of arrays, and the machines
+// are split into chunks that the threads steal from each other when they run
+// out of their own.
+class BatchEmulator
+{
+public:
+    struct Result
+    {
+        Emulator::StopReason reason = Emulator::InstructionLimit;
+        uint64_t instructions = 0;
+        uint64_t cycles = 0;
+        uint8_t a = 0;
+        uint8_t pc = 0;
+        QVector<Emulator::Output> outputs;
+    };
+
+    explicit BatchEmulator(const CPU &cpu);
+
+    // Each memory is the initial contents from address 0, anything past what
+    // the CPU can address is ignored. Runs until hlt or maxInstructions.
+    QVector<Result> run(const QVector<QByteArray> &memories, const uint64_t maxInstructions, int threadCount = 0);
+
+    static QByteArray memoryFromImage(const MemoryImage &image, const int size);
+
+    // Runs groups of machines in lockstep with SimdEmulator when the CPU
+    // allows it, on by default
+    void setSimdEnabled(const bool enabled) { m_simdEnabled = enabled; }
+    bool isSimdActive() const { return m_simdEnabled && m_simdSupported; }
+
+    int memorySize() const { return m_addressMask + 1; }
+
+private:
+    static constexpr int ChunkSize = 64;
+    static constexpr int Stride = 256; // bytes of memory and stack per machine
+
+    struct Machines
+    {
+        QVector<uint8_t> a;
+        QVector<uint8_t> b;
+        QVector<uint8_t> pc;
+        QVector<uint8_t> sp;
+        QVector<uint8_t> carry;
+        QVector<uint8_t> zero;
+        QVector<uint64_t> instructions;
+        QVector<uint8_t> memory;
+        QVector<uint8_t> stack;
+    };
+
+    void runChunk(Machines *machines, QVector<Result> *results, const int first, const int count, const uint64_t maxInstructions) const;
+
+    Emulator m_emulator; // just for the decoding
+    bool m_simdEnabled = true;
+    bool m_simdSupported = false;
+
+    Emulator::Operation m_operations[256];
+    uint8_t m_addressMask = 0xF;
+    uint8_t m_pcIncrement = 1;
+    uint8_t m_cyclesPerInstruction = 5;
+};
@@ -2,25 +2,50 @@
 #include <QFile>
 #include <QSet>
 #include <QStringList>
-#include <QMessageBox>
 #include <QDebug>
 
+static inline ushort asciiToLower(const ushort c)
+{
+    if (c >= 'A' && c <= 'Z') {
+        return c + ('a' - 'A');
+    }
+    return c;
+}
+
+// Only ASCII, the same as findOperator() does, so names with other letters
+// in them are still found when spelled the same way as in the CPU file
+static QString asciiLowered(QString name)
+{
+    for (QChar &c : name) {
+        c = QChar(asciiToLower(c.unicode()));
+    }
+    return name;
+}
+
 bool CPU::loadFile(const QString &filename)
 {
     qDebug() << "Loading CPU" << filename;
+    m_errorString.clear();
 
     QFile file(filename);
     if (!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::warning(nullptr, "Failed top open operators file", file.errorString());
+        m_errorString = "Failed to open operators file: " + file.errorString();
         return false;
     }
+    return load(file.readAll());
+}
+
+bool CPU::load(const QByteArray &contents)
+{
+    m_errorString.clear();
+
     QSet<uint8_t> usedOpcodes;
 
     QHash<QString, Operator> ops;
     int bitCount = -1;
 
-    while (!file.atEnd()) {
-        const QString &line = QString::fromUtf8(file.readLine()).simplified();
+    for (const QByteArray &rawLine : contents.split('\n')) {
+        const QString &line = QString::fromUtf8(rawLine).simplified();
         if (line.startsWith('#')) {
             continue;
         }
@@ -31,82 +56,175 @@ bool CPU::loadFile(const QString &filename)
         if (line.startsWith("bits:")) {
             bitCount = line.split(':').last().toInt(&ok);
             if (!ok) {
-                QMessageBox::warning(nullptr, "Invalid operators file", "Invalid bits specification:\n" + line);
+                m_errorString = "Invalid bits specification:\n" + line;
                 return false;
             }
             if (bitCount != 8 && bitCount != 16) {
-                QMessageBox::warning(nullptr, "Invalid operators file", "Only 8 and 16 bit opcodes are supported:\n" + line);
+                m_errorString = "Only 8 and 16 bit opcodes are supported:\n" + line;
                 return false;
             }
             continue;
         }
         const QStringList parts = line.split(';');
         if (parts.count() != 4) {
-            QMessageBox::warning(nullptr, "Invalid operators file", "Invalid line:\n" + line);
+            m_errorString = "Invalid line:\n" + line;
             return false;
         }
-        const QString name = parts[0].trimmed();
+        const QString name = asciiLowered(parts[0].trimmed());
         if (name.isEmpty()) {
-            QMessageBox::warning(nullptr, "Invalid operators file", "Missing operator name:\n" + line);
+            m_errorString = "Missing operator name:\n" + line;
             return false;
         }
         if (ops.contains(name)) {
-            QMessageBox::warning(nullptr, "Invalid operators file", "Duplicate operator:\n" + line);
+            m_errorString = "Duplicate operator:\n" + line;
             return false;
         }
         Operator op;
         QString opcode = parts[1].trimmed();
 
+        // Parse to an int first, so e.g. 0x101 doesn't silently become 1
+        int opcodeValue = 0;
         if (opcode.startsWith("0b")) {
             opcode = opcode.mid(2);
-            op.opcode = opcode.toInt(&ok, 2);
+            opcodeValue = opcode.toInt(&ok, 2);
         } else if (opcode.startsWith("0x")) {
-            op.opcode = opcode.toInt(&ok, 0);
+            opcodeValue = opcode.toInt(&ok, 0);
         } else {
-            op.opcode = opcode.toInt(&ok);
+            opcodeValue = opcode.toInt(&ok);
         }
         if (!ok) {
-            QMessageBox::warning(nullptr, "Invalid operators file", "Invalid opcode on line:\n" + line);
+            m_errorString = "Invalid opcode on line:\n" + line;
             return false;
         }
+        if (opcodeValue < 0 || opcodeValue > 0xFF) {
+            m_errorString = "Opcode out of range on line:\n" + line;
+            return false;
+        }
+        op.opcode = opcodeValue;
         if (usedOpcodes.contains(op.opcode)) {
-            QMessageBox::warning(nullptr, "Invalid operators file", "Duplicate opcode on line:\n" + line);
+            m_errorString = "Duplicate opcode on line:\n" + line;
             return false;
         }
         usedOpcodes.insert(op.opcode);
 
         op.numArguments = parts[2].trimmed().toInt(&ok);
         if (!ok || op.numArguments < 0) {
-            QMessageBox::warning(nullptr, "Invalid operators file", "Invalid number of operators on line:\n" + line);
+            m_errorString = "Invalid number of operators on line:\n" + line;
             return false;
         }
         if (op.numArguments > 1) {
-            QMessageBox::warning(nullptr, "Invalid operators file", "Only supports 0 or 1 operators for now:\n" + line);
+            m_errorString = "Only supports 0 or 1 operators for now:\n" + line;
             return false;
         }
         op.help = parts[3].trimmed();
         if (op.numArguments == 0 && op.help.contains("%1")) {
-            QMessageBox::warning(nullptr, "Invalid operators file", "Description can't contain %1 for ops without arguments:\n" + line);
+            m_errorString = "Description can't contain %1 for ops without arguments:\n" + line;
             return false;
         }
 
         ops[name] = op;
-        qDebug() << name << op.opcode << op.help;
     }
 
     if (bitCount != 8 && bitCount != 16) {
-        QMessageBox::warning(nullptr, "Invalid operators file", "No bit width specified in CPU file");
+        m_errorString = "No bit width specified in CPU file";
         return false;
     }
 
     if (ops.isEmpty()) {
-        QMessageBox::warning(nullptr, "Invalid operators file", "No operators in CPU file");
+        m_errorString = "No operators in CPU file";
         return false;
     }
 
+    // The opcode only gets the upper 4 bits in 8 bit instructions
+    if (bitCount == 8) {
+        for (QHash<QString, Operator>::const_iterator it = ops.constBegin(); it != ops.constEnd(); ++it) {
+            if (it->opcode > 0xF) {
+                m_errorString = "Opcode out of range for 8 bit instructions: " + it.key();
+                return false;
+            }
+        }
+    }
+
     m_bits = bitCount;
     m_operators = std::move(ops);
+    buildLookup();
 
     return true;
 }
 
+uint32_t CPU::hashName(const QStringView name, const uint32_t seed)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u ^ seed;
+    for (const QChar c : name) {
+        hash ^= asciiToLower(c.unicode());
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void CPU::buildLookup()
+{
+    m_lookupNames.clear();
+    m_lookupOperators.clear();
+
+    QVector<OperatorSlot> entries;
+    for (QHash<QString, Operator>::const_iterator it = m_operators.constBegin(); it != m_operators.constEnd(); ++it) {
+        OperatorSlot entry;
+        entry.nameOffset = m_lookupNames.length();
+        entry.nameLength = it.key().length();
+        entry.operatorIndex = m_lookupOperators.count();
+        entries.append(entry);
+
+        m_lookupNames += it.key();
+        m_lookupOperators.append(it.value());
+    }
+
+    // There's only a handful of operators, so just try seeds until nothing collides
+    int size = 4;
+    while (size < entries.count() * 2) {
+        size *= 2;
+    }
+    for (uint32_t seed = 0; ; seed++) {
+        if (seed != 0 && seed % 1024 == 0) {
+            size *= 2;
+        }
+
+        m_lookupSlots.fill(OperatorSlot(), size);
+        bool collided = false;
+        for (const OperatorSlot &entry : entries) {
+            const QStringView name = QStringView(m_lookupNames).mid(entry.nameOffset, entry.nameLength);
+            OperatorSlot &slot = m_lookupSlots[hashName(name, seed) & (size - 1)];
+            if (slot.operatorIndex != -1) {
+                collided = true;
+                break;
+            }
+            slot = entry;
+        }
+        if (!collided) {
+            m_lookupSeed = seed;
+            return;
+        }
+    }
+}
+
+const CPU::Operator *CPU::findOperator(const QStringView name) const
+{
+    if (m_lookupSlots.isEmpty()) {
+        return nullptr;
+    }
+
+    const OperatorSlot &slot = m_lookupSlots[hashName(name, m_lookupSeed) & (m_lookupSlots.count() - 1)];
+    if (slot.operatorIndex == -1 || slot.nameLength != name.length()) {
+        return nullptr;
+    }
+
+    const QChar *candidate = m_lookupNames.constData() + slot.nameOffset;
+    for (int i=0; i<name.length(); i++) {
+        if (asciiToLower(name[i].unicode()) != candidate[i].unicode()) {
+            return nullptr;
+        }
+    }
+    return &m_lookupOperators[slot.operatorIndex];
+}
+
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <QByteArray>
 #include <QHash>
 #include <QString>
+#include <QStringView>
+#include <QVector>
 
 struct CPU
 {
@@ -13,16 +16,42 @@ struct CPU
     };
 
     bool loadFile(const QString &filename);
+    bool load(const QByteArray &contents);
+    const QString &errorString() const { return m_errorString; }
 
     uint8_t bits() const { return m_bits; }
+
+    // How many addresses the machine can reach, 4 bit addresses on the
+    // original one and 8 bit on the extended one
+    uint32_t addressCount() const { return m_bits == 8 ? 1u << 4 : 1u << 8; }
     const QHash<QString, Operator> &operators() const { return m_operators; }
 
+    // Case insensitive, doesn't allocate, returns nullptr if there's no such operator
+    const Operator *findOperator(const QStringView name) const;
+
     bool isValid() const {
         return (m_bits == 8 || m_bits == 16) && !m_operators.isEmpty();
     }
 
 private:
+    // Perfect hash table over the operator names, built when loading
+    struct OperatorSlot
+    {
+        int nameOffset = 0;
+        int nameLength = 0;
+        int operatorIndex = -1;
+    };
+
+    static uint32_t hashName(const QStringView name, const uint32_t seed);
+    void buildLookup();
+
     int m_bits = 8;
     QHash<QString, Operator> m_operators;
+    QString m_errorString;
+
+    QString m_lookupNames; // all the names back to back
+    QVector<Operator> m_lookupOperators;
+    QVector<OperatorSlot> m_lookupSlots; // power of two size
+    uint32_t m_lookupSeed = 0;
 };
 
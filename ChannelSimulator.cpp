@@ -0,0 +1,135 @@
+#include "ChannelSimulator.h"
+#include "AudioBuffer.h"
+#include "Demodulator.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <iterator>
+#include <math.h>
+
+void ChannelSimulator::reset()
+{
+    if (inputSampleRate <= 0 || outputSampleRate <= 0) {
+        qWarning() << "Invalid sample rates" << inputSampleRate << outputSampleRate;
+        inputSampleRate = 44100;
+        outputSampleRate = 44100;
+    }
+
+    // A fast clock takes more samples of the same audio
+    m_step = inputSampleRate / (outputSampleRate * (1. + clockSkew / 1000000.));
+    m_history.fill(0.f, 1);
+    m_position = 1.;
+
+    m_random.seed(seed);
+    if (noiseLevel > 0.f) { // a zero deviation isn't allowed
+        m_noise = std::normal_distribution<float>(0.f, noiseLevel);
+    }
+
+    // One pole high-pass, the usual DC blocker
+    if (highPassFrequency > 0.) {
+        m_highPassCoefficient = float(exp(-2. * M_PI * highPassFrequency / outputSampleRate));
+    } else {
+        m_highPassCoefficient = 1.f;
+    }
+    m_previousInput = 0.f;
+    m_previousOutput = 0.f;
+
+    m_agcAttackCoefficient = float(1. - exp(-1. / (qMax(agcAttack, 1e-6) * outputSampleRate)));
+    m_agcReleaseCoefficient = float(1. - exp(-1. / (qMax(agcRelease, 1e-6) * outputSampleRate)));
+    m_envelope = agcTarget; // starts out at unity gain
+}
+
+void ChannelSimulator::process(const float *input, const size_t count, QVector<float> *output)
+{
+    if (m_history.isEmpty()) {
+        reset();
+    }
+
+    m_history.reserve(m_history.count() + int(count));
+    for (size_t i=0; i<count; i++) {
+        m_history.append(input[i]);
+    }
+
+    // Catmull-Rom between the two samples around the position, so it needs
+    // one before and one after those
+    while (m_position + 2. < m_history.count()) {
+        const int index = int(m_position);
+        const float t = float(m_position - index);
+        const float p0 = m_history[index - 1];
+        const float p1 = m_history[index];
+        const float p2 = m_history[index + 1];
+        const float p3 = m_history[index + 2];
+        const float sample = p1 + 0.5f * t * (p2 - p0 + t * (2.f * p0 - 5.f * p1 + 4.f * p2 - p3 + t * (3.f * (p1 - p2) + p3 - p0)));
+
+        output->append(receive(sample));
+        m_position += m_step;
+    }
+
+    // Keep the one before the position
+    const int used = qMin(int(m_position) - 1, m_history.count());
+    if (used > 0) {
+        m_history.remove(0, used);
+        m_position -= used;
+    }
+}
+
+QByteArray ChannelSimulator::loopback(AudioBuffer *modulator, Demodulator *demodulator, const QByteArray &bytes, Timings *timings)
+{
+    QByteArray received;
+    QVector<float> channelOutput;
+    float samples[4096];
+    int queued = 0;
+    bool done = false;
+    QElapsedTimer timer;
+    while (!done) {
+        queued += modulator->appendBytes(QByteArray::fromRawData(bytes.constData() + queued, bytes.count() - queued));
+        done = queued == bytes.count() && modulator->isEmpty();
+
+        if (timings) {
+            timer.start();
+        }
+        modulator->takeFrames(std::size(samples), samples);
+        if (timings) {
+            timings->modulateNsecs += timer.nsecsElapsed();
+            timings->frames += std::size(samples);
+        }
+
+        channelOutput.clear();
+        process(samples, std::size(samples), &channelOutput);
+
+        if (timings) {
+            timer.restart();
+        }
+        demodulator->process(channelOutput.constData(), size_t(channelOutput.count()));
+        if (timings) {
+            timings->demodulateNsecs += timer.nsecsElapsed();
+            timings->samples += channelOutput.count();
+        }
+
+        received += demodulator->takeBytes();
+    }
+    return received;
+}
+
+float ChannelSimulator::receive(float sample)
+{
+    if (noiseLevel > 0.f) {
+        sample += m_noise(m_random);
+    }
+
+    if (m_highPassCoefficient < 1.f) {
+        const float filtered = sample - m_previousInput + m_highPassCoefficient * m_previousOutput;
+        m_previousInput = sample;
+        m_previousOutput = filtered;
+        sample = filtered;
+    }
+
+    if (agcEnabled) {
+        const float level = fabsf(sample);
+        m_envelope += (level > m_envelope ? m_agcAttackCoefficient : m_agcReleaseCoefficient) * (level - m_envelope);
+        sample *= qMin(agcTarget / qMax(m_envelope, 1e-9f), agcMaxGain);
+    }
+
+    return qBound(-1.f, sample, 1.f);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <QByteArray>
+#include <QVector>
+
+#include <random>
+
+class AudioBuffer;
+class Demodulator;
+
+// Pretends to be the cable and soundcard between the AudioBuffer and the
+// Demodulator, so we can find out what survives without any hardware.
+//
+// In order: resampled to the receiving sample rate with a clock that's a bit
+// off, white noise added, DC removed with a high-pass like soundcard inputs
+// have, levelled by an AGC and finally clipped like an ADC would.
+class ChannelSimulator
+{
+public:
+    int inputSampleRate = 44100;
+    int outputSampleRate = 44100; // what the receiver thinks it is, give the same to the demodulator
+    double clockSkew = 0.; // in ppm, positive if the receiving clock runs fast
+
+    float noiseLevel = 0.f; // RMS, 1 is full scale
+    double highPassFrequency = 20.; // 0 for none
+
+    // Aims for this peak level, reacts quickly when it gets louder and
+    // slowly when it gets quieter
+    bool agcEnabled = false;
+    float agcTarget = 0.5f;
+    double agcAttack = 0.01; // seconds
+    double agcRelease = 0.5;
+    float agcMaxGain = 1000.f;
+
+    uint32_t seed = 1;
+
+    // Call after changing the settings
+    void reset();
+
+    // Appends what comes out on the other side to output
+    void process(const float *input, const size_t count, QVector<float> *output);
+
+    // How long modulating and demodulating took in loopback()
+    struct Timings
+    {
+        qint64 modulateNsecs = 0;
+        qint64 demodulateNsecs = 0;
+        int64_t frames = 0; // sent
+        int64_t samples = 0; // received
+    };
+
+    // Sends all of the bytes from the modulator, through us and into the
+    // demodulator, and returns what comes out. The modulator has to be
+    // prepared, and the demodulator set up with our output sample rate.
+    QByteArray loopback(AudioBuffer *modulator, Demodulator *demodulator, const QByteArray &bytes, Timings *timings = nullptr);
+
+private:
+    float receive(float sample);
+
+    // Input samples not yet used up by the resampler, first one is before m_position
+    QVector<float> m_history;
+    double m_position = 1.; // in input samples, from the start of m_history
+    double m_step = 1.; // input samples per output sample
+
+    std::mt19937 m_random;
+    std::normal_distribution<float> m_noise;
+
+    float m_highPassCoefficient = 1.f;
+    float m_previousInput = 0.f;
+    float m_previousOutput = 0.f;
+
+    float m_agcAttackCoefficient = 0.f;
+    float m_agcReleaseCoefficient = 0.f;
+    float m_envelope = 0.f;
+};
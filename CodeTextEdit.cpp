@@ -1,4 +1,5 @@
 #include "CodeTextEdit.h"
+#include "Tokenizer.h"
 
 #include <QPainter>
 #include <QTextBlock>
@@ -78,9 +79,27 @@ void CodeTextEdit::highlightCurrentLine()
         extraSelections.append(selection);
     }
 
+    const QTextBlock executing = document()->findBlockByNumber(m_executingLine);
+    if (m_executingLine >= 0 && executing.isValid()) {
+        QTextEdit::ExtraSelection selection;
+        selection.format.setBackground(QColor(Qt::green).lighter(160));
+        selection.format.setProperty(QTextFormat::FullWidthSelection, true);
+        selection.cursor = QTextCursor(executing);
+        extraSelections.append(selection);
+    }
+
     setExtraSelections(extraSelections);
 }
 
+void CodeTextEdit::setExecutingLine(const int line)
+{
+    if (line == m_executingLine) {
+        return;
+    }
+    m_executingLine = line;
+    highlightCurrentLine();
+}
+
 void CodeTextEdit::lineNumberAreaPaintEvent(QPaintEvent *event)
 {
     QPainter painter(lineNumberArea);
@@ -90,14 +109,14 @@ void CodeTextEdit::lineNumberAreaPaintEvent(QPaintEvent *event)
     int bottom = top + qRound(blockBoundingRect(block).height());
     int bytes = 0;
 
-    QRegularExpression labelRegex("^\\s*([a-zA-Z][a-zA-Z0-9]*:)\\s*(;.*)?$");
-
     while (block.isValid() && top <= event->rect().bottom()) {
-        const QString lineContent = block.text().trimmed();
+        const QString lineContent = block.text();
+        Tokenizer tokenizer(lineContent);
+        Token token;
         const bool isEmpty =
-                lineContent.isEmpty() ||
-                lineContent.startsWith(';') ||
-                lineContent.startsWith(".db") ;
+                !tokenizer.next(&token) ||
+                token.type == Token::Comment ||
+                token.type == Token::Directive;
 
         if (!isEmpty && block.isVisible() && bottom >= event->rect().top()) {
             QString number = QString::number(bytes);
@@ -106,7 +125,7 @@ void CodeTextEdit::lineNumberAreaPaintEvent(QPaintEvent *event)
                              Qt::AlignRight, number);
         }
 
-        if (!isEmpty && !lineContent.contains(labelRegex)) {
+        if (!isEmpty && token.type != Token::Label) {
             bytes += bytesPerLine;
         }
 
@@ -152,51 +171,54 @@ void SyntaxHighlighter::highlightBlock(const QString &text)
     warningFormat.setForeground(Qt::darkRed);
     warningFormat.setFontWeight(QFont::Bold);
 
-    QRegularExpression expression(";.*$");
-    QRegularExpressionMatchIterator i = expression.globalMatch(text);
-    while (i.hasNext()) {
-        QRegularExpressionMatch match = i.next();
-        setFormat(match.capturedStart(), match.capturedLength(), commentFormat);
-    }
-
-    const QString dataRegex("(0x[0-9A-Fa-f]+|[0-9]+)");
-
-    {
-        expression.setPattern("^(\\.db) " + dataRegex + " " + dataRegex + "( [a-zA-Z][a-zA-Z0-9]*)?");
-        i = expression.globalMatch(text);
-        while (i.hasNext()) {
-            QRegularExpressionMatch match = i.next();
-            setFormat(match.capturedStart(1), match.capturedLength(1), dbFormat);
-            setFormat(match.capturedStart(2), match.capturedLength(2), addressFormat);
-            setFormat(match.capturedStart(3), match.capturedLength(3), varFormat);
-            if (match.capturedTexts().count() > 3) {
-                setFormat(match.capturedStart(4), match.capturedLength(4), varNameFormat);
-            }
-        }
-    }
+    QRegularExpression expression;
+    QRegularExpressionMatchIterator i;
 
     if (!m_ops.isEmpty()) {
-        expression.setPattern("^\\s*(" + m_ops.join('|') + ")\\b");
-        QRegularExpressionMatchIterator i = expression.globalMatch(text);
-        while (i.hasNext()) {
-            QRegularExpressionMatch match = i.next();
-            setFormat(match.capturedStart(), match.capturedLength(), opcodeFormat);
+        Tokenizer tokenizer(text);
+        Token token;
+        bool isData = false;
+        int index = 0;
+        while (tokenizer.next(&token)) {
+            switch(token.type) {
+            case Token::Comment:
+                setFormat(token.start, token.text.length(), commentFormat);
+                break;
+            case Token::Label:
+                setFormat(token.start, token.text.length() + 1, labelFormat); // include the :
+                break;
+            case Token::Directive:
+                isData = token.text.compare(QStringView(u".db"), Qt::CaseInsensitive) == 0;
+                if (isData) {
+                    setFormat(token.start, token.text.length(), dbFormat);
+                }
+                break;
+            case Token::Mnemonic:
+                if (m_ops.contains(token.text, Qt::CaseInsensitive)) {
+                    setFormat(token.start, token.text.length(), opcodeFormat);
+                }
+                break;
+            case Token::Number:
+                if (isData && index == 1) {
+                    setFormat(token.start, token.text.length(), addressFormat);
+                } else {
+                    setFormat(token.start, token.text.length(), varFormat);
+                }
+                break;
+            case Token::Identifier:
+                setFormat(token.start, token.text.length(), varNameFormat);
+                break;
+            }
+            index++;
         }
-
-        expression.setPattern("^[a-zA-Z ]+" + dataRegex);
+    } else {
+        expression.setPattern(";.*$");
         i = expression.globalMatch(text);
         while (i.hasNext()) {
             QRegularExpressionMatch match = i.next();
-            setFormat(match.capturedStart(1), match.capturedLength(1), varFormat);
+            setFormat(match.capturedStart(), match.capturedLength(), commentFormat);
         }
 
-        expression.setPattern(" ([a-zA-Z][a-zA-Z0-9]*)$");
-        i = expression.globalMatch(text);
-        while (i.hasNext()) {
-            QRegularExpressionMatch match = i.next();
-            setFormat(match.capturedStart(1), match.capturedLength(1), varNameFormat);
-        }
-    } else {
         expression.setPattern("([01 ]+):\\s+([01]+)\\s+([01]+)");
         i = expression.globalMatch(text);
 
@@ -206,19 +228,12 @@ void SyntaxHighlighter::highlightBlock(const QString &text)
             setFormat(match.capturedStart(2), match.capturedLength(2), binFormat1);
             setFormat(match.capturedStart(3), match.capturedLength(3), binFormat2);
         }
-
     }
+
     expression = QRegularExpression(";.*(WARNING).*");
     i = expression.globalMatch(text);
     while (i.hasNext()) {
         QRegularExpressionMatch match = i.next();
         setFormat(match.capturedStart(1), match.capturedLength(1), warningFormat);
     }
-
-    expression = QRegularExpression("^\\s*([a-zA-Z][a-zA-Z0-9]*:)\\s*(;.*)?$");
-    i = expression.globalMatch(text);
-    while (i.hasNext()) {
-        QRegularExpressionMatch match = i.next();
-        setFormat(match.capturedStart(1), match.capturedLength(1), labelFormat);
-    }
 }
@@ -36,6 +36,9 @@ public:
     }
     SyntaxHighlighter *highlighter() const { return m_highlighter; }
 
+    // Marks the line the emulator is at, without touching the cursor. -1 to clear.
+    void setExecutingLine(const int line);
+
 protected:
     void resizeEvent(QResizeEvent *event) override;
 
@@ -50,6 +53,7 @@ private:
     QWidget *lineNumberArea;
     SyntaxHighlighter *m_highlighter;
     int bytesPerLine = 4;
+    int m_executingLine = -1;
 };
 
 class LineNumberArea : public QWidget
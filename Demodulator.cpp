@@ -0,0 +1,262 @@
+#include "Demodulator.h"
+
+#include <QDebug>
+#include <QFile>
+
+#include <cstring>
+#include <math.h>
+
+void Demodulator::Correlator::setup(const double frequency, const int sampleRate, const int windowLength)
+{
+    phasor = 1.;
+    step = std::polar(1., -2. * M_PI * frequency / sampleRate);
+    sum = 0.;
+    history.fill(0., windowLength);
+}
+
+void Demodulator::reset()
+{
+    if (sampleRate <= 0 || baud <= 0) {
+        qWarning() << "Invalid sample rate or baud" << sampleRate << baud;
+        baud = 300;
+        sampleRate = 44100;
+    }
+    if (frequencies.count() != AudioBuffer::symbolCount(encoding)) {
+        qWarning() << "Need" << AudioBuffer::symbolCount(encoding) << "frequencies, got" << frequencies.count();
+        frequencies.resize(AudioBuffer::symbolCount(encoding));
+    }
+    m_samplesPerBit = double(sampleRate) / baud;
+    m_windowLength = qMax(1, int(lround(m_samplesPerBit)));
+    m_windowPosition = 0;
+
+    m_correlators.resize(frequencies.count());
+    for (int i=0; i<frequencies.count(); i++) {
+        m_correlators[i].setup(frequencies[i], sampleRate, m_windowLength);
+    }
+
+    m_peakEnergy = 0.;
+    m_peakDecay = pow(0.5, 1. / sampleRate);
+
+    m_state = Idle;
+    m_sampleIndex = 0;
+    m_markRun = 0;
+    m_bitNum = 0;
+    m_currentByte = 0;
+
+    m_received.clear();
+    m_byteCount = 0;
+    m_framingErrors = 0;
+}
+
+void Demodulator::setup(const AudioBuffer &modulator, const int inputSampleRate)
+{
+    encoding = modulator.m_encoding;
+    sampleRate = inputSampleRate;
+    baud = modulator.baud;
+    frequencies.resize(AudioBuffer::symbolCount(encoding));
+    for (int symbol=0; symbol<frequencies.count(); symbol++) {
+        frequencies[symbol] = modulator.symbolFrequency(symbol);
+    }
+    reset();
+}
+
+void Demodulator::process(const float *samples, const size_t count)
+{
+    if (m_correlators.isEmpty() || m_correlators[0].history.count() != m_windowLength) {
+        reset();
+    }
+    const int carrier = m_correlators.count() - 1;
+
+    for (size_t i=0; i<count; i++, m_sampleIndex++) {
+        const double sample = samples[i];
+
+        int strongest = 0;
+        double strongestEnergy = -1.;
+        double energy = 0.;
+        for (int symbol=0; symbol<m_correlators.count(); symbol++) {
+            Correlator &correlator = m_correlators[symbol];
+            const std::complex<double> product = sample * correlator.phasor;
+            std::complex<double> &oldest = correlator.history[m_windowPosition];
+            correlator.sum += product - oldest;
+            oldest = product;
+            correlator.phasor *= correlator.step;
+
+            const double symbolEnergy = correlator.energy();
+            energy += symbolEnergy;
+            if (symbolEnergy > strongestEnergy) {
+                strongestEnergy = symbolEnergy;
+                strongest = symbol;
+            }
+        }
+        m_windowPosition++;
+        if (m_windowPosition >= m_windowLength) {
+            m_windowPosition = 0;
+
+            // Rounding errors pile up otherwise
+            for (Correlator &correlator : m_correlators) {
+                correlator.phasor /= std::abs(correlator.phasor);
+            }
+        }
+
+        m_peakEnergy = qMax(energy, m_peakEnergy * m_peakDecay);
+        if (energy < m_peakEnergy * 0.1) {
+            // Lost the carrier, whatever we were in the middle of is gone
+            m_state = Idle;
+            m_markRun = 0;
+            continue;
+        }
+
+        if (m_state == Idle) {
+            if (strongest == carrier) {
+                m_markRun++;
+                continue;
+            }
+
+            // Going from the carrier to anything else is the start symbol,
+            // the window is about half way into it now
+            if (m_markRun >= m_windowLength) {
+                m_state = Receiving;
+                m_bitNum = 0;
+                m_currentByte = 0;
+                m_nextBitSample = m_sampleIndex + m_samplesPerBit / 2.;
+            }
+            m_markRun = 0;
+            continue;
+        }
+
+        if (m_sampleIndex >= m_nextBitSample) {
+            processBit(strongest);
+            m_nextBitSample += m_samplesPerBit;
+        }
+    }
+}
+
+void Demodulator::processBit(const int symbol)
+{
+    const int bits = AudioBuffer::bitsPerSymbol(encoding);
+    const int dataSymbols = AudioBuffer::dataSymbols(encoding);
+    const int carrier = m_correlators.count() - 1;
+
+    if (m_bitNum == 0) {
+        // Just noise, not a start bit after all
+        if (symbol != 0) {
+            m_state = Idle;
+            m_markRun = 0;
+            return;
+        }
+    } else if (m_bitNum <= dataSymbols) {
+        m_currentByte |= uint32_t(symbol) << ((m_bitNum - 1) * bits);
+    } else {
+        if (symbol == carrier) {
+            m_received.append(char(m_currentByte & 0xff));
+            m_byteCount++;
+
+            // We're half way into the stop bit, which is enough idle for
+            // the next start bit
+            m_markRun = m_windowLength;
+        } else {
+            m_framingErrors++;
+            m_markRun = 0;
+        }
+        m_state = Idle;
+        return;
+    }
+    m_bitNum++;
+}
+
+QByteArray Demodulator::takeBytes()
+{
+    QByteArray ret;
+    ret.swap(m_received);
+    return ret;
+}
+
+namespace {
+uint32_t readLE(const uchar *data, const int size)
+{
+    uint32_t value = 0;
+    for (int i=0; i<size; i++) {
+        value |= uint32_t(data[i]) << (i * 8);
+    }
+    return value;
+}
+} // namespace
+
+bool Demodulator::readWavFile(const QString &filename, QVector<float> *samples, int *sampleRate, QString *errorString)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *errorString = file.errorString();
+        return false;
+    }
+    const QByteArray contents = file.readAll();
+    const uchar *data = reinterpret_cast<const uchar*>(contents.constData());
+    const int size = contents.size();
+
+    if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) {
+        *errorString = "Not a WAV file";
+        return false;
+    }
+
+    int format = 0;
+    int channels = 0;
+    int bitsPerSample = 0;
+    const uchar *sampleData = nullptr;
+    int sampleDataSize = 0;
+
+    // Walk the chunks, there might be other stuff than fmt and data
+    for (int offset = 12; offset + 8 <= size;) {
+        const int chunkSize = int(qMin<uint32_t>(readLE(data + offset + 4, 4), uint32_t(size - offset - 8)));
+        const uchar *chunk = data + offset + 8;
+        if (memcmp(data + offset, "fmt ", 4) == 0 && chunkSize >= 16) {
+            format = int(readLE(chunk, 2));
+            channels = int(readLE(chunk + 2, 2));
+            *sampleRate = int(readLE(chunk + 4, 4));
+            bitsPerSample = int(readLE(chunk + 14, 2));
+
+            // WAVE_FORMAT_EXTENSIBLE, the actual format is in the sub format
+            if (format == 0xFFFE && chunkSize >= 26) {
+                format = int(readLE(chunk + 24, 2));
+            }
+        } else if (memcmp(data + offset, "data", 4) == 0) {
+            sampleData = chunk;
+            sampleDataSize = chunkSize;
+        }
+        offset += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    const bool isPcm = format == 1 && (bitsPerSample == 8 || bitsPerSample == 16 || bitsPerSample == 24 || bitsPerSample == 32);
+    const bool isFloat = format == 3 && bitsPerSample == 32;
+    if (!isPcm && !isFloat) {
+        *errorString = QString("Unsupported format %1 with %2 bits per sample").arg(format).arg(bitsPerSample);
+        return false;
+    }
+    if (channels <= 0 || *sampleRate <= 0 || !sampleData) {
+        *errorString = "Invalid WAV file";
+        return false;
+    }
+
+    const int bytesPerSample = bitsPerSample / 8;
+    const int frameCount = sampleDataSize / (bytesPerSample * channels);
+    samples->resize(frameCount);
+    for (int frame=0; frame<frameCount; frame++) {
+        float sum = 0.f;
+        for (int channel=0; channel<channels; channel++) {
+            const uchar *sample = sampleData + (frame * channels + channel) * bytesPerSample;
+            if (isFloat) {
+                float value;
+                memcpy(&value, sample, sizeof value);
+                sum += value;
+            } else if (bitsPerSample == 8) {
+                sum += (int(*sample) - 128) / 128.f; // the only unsigned one
+            } else {
+                // Shift it up so the sign ends up in the right place
+                const int32_t value = int32_t(readLE(sample, bytesPerSample) << (32 - bitsPerSample));
+                sum += value / 2147483648.f;
+            }
+        }
+        (*samples)[frame] = sum / channels;
+    }
+
+    return true;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "AudioBuffer.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include <complex>
+
+// Turns the tones sent by AudioBuffer back into bytes, so we can check what
+// actually went out (e.g. with a cable from the output to the input, or from
+// a recording).
+//
+// Each tone is correlated with the input over a sliding window of one symbol
+// (like a running Goertzel filter), and whichever has the most energy decides
+// the symbol. The bytes are framed like a UART does it: wait for idle
+// carrier, see the edge of the start symbol and then sample every symbol in
+// the middle.
+class Demodulator
+{
+public:
+    AudioBuffer::Encoding encoding = AudioBuffer::Ascii8N1;
+    int sampleRate = 44100;
+    int baud = 300;
+
+    // The tone for each symbol as they are on the wire, see
+    // AudioBuffer::symbolFrequency(). The last one is the carrier.
+    QVector<int> frequencies = { 2225, 2025 };
+
+    // Call after changing the settings, forgets everything received so far
+    void reset();
+
+    // Same settings as what the modulator sends, and resets
+    void setup(const AudioBuffer &modulator, const int inputSampleRate);
+
+    void process(const float *samples, const size_t count);
+
+    // What's been received since the last call
+    QByteArray takeBytes();
+
+    int64_t byteCount() const { return m_byteCount; }
+    int64_t framingErrors() const { return m_framingErrors; }
+
+    // Mono, or all channels mixed down. 8, 16, 24 and 32 bit PCM and 32 bit float.
+    static bool readWavFile(const QString &filename, QVector<float> *samples, int *sampleRate, QString *errorString);
+
+private:
+    struct Correlator
+    {
+        std::complex<double> phasor = 1.;
+        std::complex<double> step = 1.;
+        std::complex<double> sum;
+        QVector<std::complex<double>> history; // one bit of products, to take them out again
+
+        void setup(const double frequency, const int sampleRate, const int windowLength);
+        double energy() const { return std::norm(sum); }
+    };
+
+    enum State {
+        Idle,
+        Receiving
+    };
+
+    void processBit(const int symbol);
+
+    QVector<Correlator> m_correlators; // one for each symbol
+    int m_windowLength = 1;
+    int m_windowPosition = 0;
+    double m_samplesPerBit = 1.;
+
+    // Carrier detect, we're only listening when the tones are within 10 dB
+    // of the loudest they've been lately (which fades by half every second)
+    double m_peakEnergy = 0.;
+    double m_peakDecay = 1.;
+
+    State m_state = Idle;
+    int64_t m_sampleIndex = 0;
+    int m_markRun = 0; // samples of carrier in a row, need a whole symbol of it before a start symbol
+    double m_nextBitSample = 0.; // middle of the next symbol, or really the end of its window
+    int m_bitNum = 0; // symbol in the frame
+    uint32_t m_currentByte = 0;
+
+    QByteArray m_received;
+    int64_t m_byteCount = 0;
+    int64_t m_framingErrors = 0;
+};
@@ -1,12 +1,15 @@
 #include "Editor.h"
+#include "Assembler.h"
 #include "Modem.h"
 #include "CodeTextEdit.h"
+#include "EmulatorRunner.h"
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QPlainTextEdit>
 #include <QScrollBar>
 #include <QHash>
 #include <cstdint>
+#include <limits>
 #include <QDebug>
 #include <QSerialPort>
 #include <QSerialPortInfo>
@@ -22,6 +25,8 @@
 #include <QTimer>
 #include <QFileDialog>
 #include <QTextBlock>
+#include <QTextDocument>
+#include <QTextCursor>
 #include <QSpinBox>
 #include <QSlider>
 #include <QWindow>
@@ -32,9 +37,12 @@
 #include <QFileInfo>
 #include <QLabel>
 #include <QDesktopServices>
+#include <QFontDatabase>
 
 #include <QtMath>
 
+static const int s_baudRates[] = { 110, 300, 1200, 9600, 19200, 57600, 115200 };
+
 static const char *s_settingsKeyVolume = "Volume";
 static const char *s_settingsKeyModemBaudRate = "modemBaudRate";
 static const char *s_settingsKeySerialBaudRate = "serialBaudRate";
@@ -43,6 +51,7 @@ static const char *s_settingsKeyLastFile = "lastOpenedFile";
 static const char *s_settingsKeySpaceFreq = "spaceFreq";
 static const char *s_settingsKeyMarkFreq = "markFreq";
 static const char *s_settingsKeyWaveform = "waveform";
+static const char *s_settingsKeyEncoding = "encoding";
 
 static const char *s_settingsKeyCPUFile = "cpuspec";
 static const char *s_internalCPUFile = ":/cpu-original.txt";
@@ -180,6 +189,42 @@ Editor::Editor(QWidget *parent)
     new SyntaxHighlighter(m_binOutput->document());
     editorLayout->addWidget(m_binOutput);
 
+    // Emulator
+    QHBoxLayout *emulatorLayout = new QHBoxLayout;
+    m_runButton = new QPushButton("Run (F6)");
+    m_runButton->setIcon(QIcon::fromTheme("media-playback-start"));
+    m_runButton->setShortcut(Qt::Key_F6);
+    m_runButton->setCheckable(true);
+    m_stepButton = new QPushButton("Step (F7)");
+    m_stepButton->setIcon(QIcon::fromTheme("media-skip-forward"));
+    m_stepButton->setShortcut(Qt::Key_F7);
+    QPushButton *resetEmulatorButton = new QPushButton("Reset");
+    resetEmulatorButton->setIcon(QIcon::fromTheme("media-skip-backward"));
+
+    m_speedSelect = new QComboBox;
+    m_speedSelect->addItem("Full speed", 0);
+    m_speedSelect->addItem("1M instructions/s", 1000000);
+    m_speedSelect->addItem("1000 instructions/s", 1000);
+    m_speedSelect->addItem("100 instructions/s", 100);
+    m_speedSelect->addItem("10 instructions/s", 10);
+    m_speedSelect->addItem("1 instruction/s", 1);
+
+    m_emulatorStatus = new QLabel;
+    m_emulatorStatus->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+
+    emulatorLayout->addWidget(new QLabel("Emulator:"));
+    emulatorLayout->addWidget(m_runButton);
+    emulatorLayout->addWidget(m_stepButton);
+    emulatorLayout->addWidget(resetEmulatorButton);
+    emulatorLayout->addWidget(m_speedSelect);
+    emulatorLayout->addWidget(m_emulatorStatus, 1);
+
+    m_emulator.reset(new EmulatorRunner);
+
+    // Whatever the emulator does we only update once per frame
+    m_emulatorTimer = new QTimer(this);
+    m_emulatorTimer->setInterval(16);
+
     // Uploader
     m_uploadButton = new QPushButton("Upload (F5)");
     m_uploadButton->setIcon(QIcon::fromTheme("cloud-upload"));
@@ -271,19 +316,26 @@ Editor::Editor(QWidget *parent)
     m_settingsLayout->addWidget(m_waveformSelect);
     m_settingsLayout->addStretch();
 
+    m_encodingSelect = new QComboBox;
+    m_encodingSelect->addItems({
+        tr("Bell 103"),
+        tr("Bell 202"),
+        tr("4-FSK"),
+        tr("8-FSK"),
+        tr("16-FSK"),
+        });
+    m_encodingSelect->setToolTip(tr("Only Bell 103 uses the space and mark frequencies, and has carrier around every byte.\nThe others are faster, but need something smarter than a tone decoder on the other end."));
+    m_settingsLayout->addWidget(new QLabel(tr("Mode:")));
+    m_settingsLayout->addWidget(m_encodingSelect);
+    m_settingsLayout->addStretch();
+
     m_baudSelect = new BaudEdit();
 
     m_baudSelect->setEditable(true);
     m_baudSelect->setValidator(new QIntValidator(1, 256000, this));
-    m_baudSelect->addItems({
-        "110",
-        "300",
-        "1200",
-        "9600",
-        "19200",
-        "57600",
-        "115200",
-    });
+    for (const int baud : s_baudRates) {
+        m_baudSelect->addItem(QString::number(baud));
+    }
     m_settingsLayout->addWidget(new QLabel(tr("Baud:")));
     m_settingsLayout->addWidget(m_baudSelect);
 
@@ -295,6 +347,7 @@ Editor::Editor(QWidget *parent)
 
     mainLayout->addLayout(topLayout);
     mainLayout->addLayout(editorLayout, 2);
+    mainLayout->addLayout(emulatorLayout);
     mainLayout->addLayout(m_settingsLayout);
     mainLayout->addLayout(uploadLayout);
     mainLayout->addWidget(m_progressBar);
@@ -309,6 +362,12 @@ Editor::Editor(QWidget *parent)
     m_serialOutput->setPlaceholderText("Serial response");
     uploadBottomLayout->addWidget(m_serialOutput);
 
+    m_emulatorOutput = new QPlainTextEdit;
+    m_emulatorOutput->setReadOnly(true);
+    m_emulatorOutput->setPlaceholderText("Emulator output");
+    m_emulatorOutput->setMaximumBlockCount(EmulatorRunner::MaxPendingOutputs);
+    uploadBottomLayout->addWidget(m_emulatorOutput);
+
     QSettings settings;
 
     loadFile(settings.value(s_settingsKeyLastFile).toString());
@@ -338,6 +397,9 @@ Editor::Editor(QWidget *parent)
 
     m_modem->setWaveform(settings.value(s_settingsKeyWaveform, AudioBuffer::Sine).toInt());
     m_waveformSelect->setCurrentIndex(m_modem->currentWaveform());
+    m_modem->setEncoding(settings.value(s_settingsKeyEncoding, AudioBuffer::Ascii8N1).toInt());
+    m_encodingSelect->setCurrentIndex(m_modem->currentEncoding());
+    updateBaudChoices();
     reloadCPU();
 
     QTimer *timer = new QTimer(this);
@@ -354,7 +416,7 @@ Editor::Editor(QWidget *parent)
     connect(loadCPUButton, &QPushButton::clicked, this, &Editor::onLoadCPUClicked);
     connect(editCPUButton, &QPushButton::clicked, this, &Editor::onEditCPUClicked);
     connect(m_asmEdit->verticalScrollBar(), &QScrollBar::valueChanged, this, &Editor::onScrolled);
-    connect(m_asmEdit, &QPlainTextEdit::textChanged, this, &Editor::onAsmChanged);
+    connect(m_asmEdit->document(), &QTextDocument::contentsChange, this, &Editor::onAsmContentsChanged);
     connect(m_asmEdit, &QPlainTextEdit::cursorPositionChanged, this, &Editor::onCursorMoved);
     connect(m_baudSelect, &QComboBox::textActivated, this, &Editor::onBaudChanged); // meh, use currenttext because the other is overloaded
     connect(m_spaceFreq, &QSpinBox::textChanged, this, &Editor::onFrequencyChanged); // valueChanged is fucked because wtf qt
@@ -366,6 +428,12 @@ Editor::Editor(QWidget *parent)
     connect(m_modem, &Modem::progress, m_progressBar, &QProgressBar::setValue);
     connect(m_outputSelect, &QComboBox::textActivated, this, &Editor::onOutputChanged);
     connect(m_waveformSelect, qOverload<int>(&QComboBox::currentIndexChanged), this, &Editor::onWaveformSelected);
+    connect(m_encodingSelect, qOverload<int>(&QComboBox::currentIndexChanged), this, &Editor::onEncodingSelected);
+    connect(m_runButton, &QPushButton::clicked, this, &Editor::onRunClicked);
+    connect(m_stepButton, &QPushButton::clicked, this, &Editor::onStepClicked);
+    connect(resetEmulatorButton, &QPushButton::clicked, this, &Editor::onResetEmulatorClicked);
+    connect(m_speedSelect, qOverload<int>(&QComboBox::currentIndexChanged), this, &Editor::onSpeedChanged);
+    connect(m_emulatorTimer, &QTimer::timeout, this, &Editor::updateEmulatorStatus);
 
     m_volumeSlider->setValue(settings.value(s_settingsKeyVolume, 100).toInt());
 
@@ -407,6 +475,7 @@ void Editor::reloadCPU()
         cpuFile = defaultCPUFile;
     }
     if (!m_cpu.loadFile(cpuFile) || !m_cpu.isValid()) {
+        QMessageBox::warning(this, "Invalid operators file", m_cpu.errorString());
         qDebug() << "Loading" << cpuFile << "failed, using bundled";
         cpuFile = s_internalCPUFile;
         m_cpu.loadFile(cpuFile);
@@ -426,41 +495,335 @@ void Editor::reloadCPU()
 
 void Editor::onAsmChanged()
 {
-    m_labels.clear();
-    m_usedLabels.clear();
-    int num = 0;
-    // TODO: better way to resolve names
-    for (const QString &line : m_asmEdit->toPlainText().split('\n')) {
-        parseToBinary(line, &num, true);
-    }
+    m_assembler.setSource(m_asmEdit->toPlainText());
+    m_assembler.reassemble();
+    const Assembler::Result &result = m_assembler.result();
 
-    m_binOutput->clear();
-    m_memory.clear();
     m_outputLineNumbers.clear();
-    num = 0;
+    m_outputLineCounts.clear();
     int outputLineNum = 0;
-//    m_outputLineNumbers.append(0);
-    for (const QString &line : m_asmEdit->toPlainText().split('\n')) {
-        const QString output = parseToBinary(line, &num, false);
+    QString output;
+    for (const QString &listing : result.listing) {
+        m_outputLineNumbers.append(outputLineNum);
 
         // TODO: no point in trying to sync up empty lines when there isn't 1-1 mapping between lines
-        if (output.isEmpty()) {
-            m_outputLineNumbers.append(outputLineNum);
+        if (listing.isEmpty()) {
+            m_outputLineCounts.append(0);
             continue;
         }
 
-        m_outputLineNumbers.append(outputLineNum);
-        outputLineNum += output.count('\n') + 1;
-        m_binOutput->insertPlainText(output + "\n");
+        const int lineCount = listing.count('\n') + 1;
+        m_outputLineCounts.append(lineCount);
+        outputLineNum += lineCount;
+        output += listing + "\n";
     }
+    m_outputLineCount = outputLineNum;
+
+    m_binOutput->clear();
+    m_binOutput->insertPlainText(output);
 
     m_memContents->clear();
+    m_memContents->insertPlainText(result.memoryContents());
+    m_memory = result.memory;
+    m_emulatorLoaded = false;
+}
+
+void Editor::onAsmContentsChanged(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+
+    const QTextDocument *document = m_asmEdit->document();
+    const int firstLine = document->findBlock(position).blockNumber();
+    const int lastLine = document->findBlock(qMin(position + charsAdded, document->characterCount() - 1)).blockNumber();
+    const int addedLines = lastLine - firstLine + 1;
+    const int removedLines = addedLines - (document->blockCount() - m_assembler.lineCount());
+
+    if (firstLine < 0 || removedLines < 0 || firstLine + removedLines > m_assembler.lineCount()) {
+        qWarning() << "Invalid change" << position << charsRemoved << charsAdded << "reassembling everything";
+        onAsmChanged();
+        return;
+    }
+
+    QStringList lines;
+    QTextBlock block = document->findBlockByNumber(firstLine);
+    for (int i=0; i<addedLines; i++, block = block.next()) {
+        lines.append(block.text());
+    }
+
+    m_assembler.replaceLines(firstLine, removedLines, lines);
+    const QVector<int> changedLines = m_assembler.reassemble();
+    if (changedLines.isEmpty() && removedLines == addedLines) {
+        return;
+    }
+
+    updateOutput(firstLine, removedLines, addedLines, changedLines);
+    updateMemoryContents();
+}
+
+void Editor::updateOutput(const int firstLine, const int removedLines, const int addedLines, const QVector<int> &changedLines)
+{
+    const QStringList &listing = m_assembler.result().listing;
+
+    // Ranges of assembly lines to replace, both in the old and the new line numbers
+    struct Edit {
+        int oldFirst;
+        int oldLast;
+        int newFirst;
+        int newLast;
+    };
+    QVector<Edit> edits;
+    auto addEdit = [&edits](const int oldFirst, const int oldLast, const int newFirst, const int newLast) {
+        if (!edits.isEmpty() && edits.last().oldLast == oldFirst && edits.last().newLast == newFirst) {
+            edits.last().oldLast = oldLast;
+            edits.last().newLast = newLast;
+            return;
+        }
+        edits.append({oldFirst, oldLast, newFirst, newLast});
+    };
+
+    bool editedAdded = false;
+    for (const int line : changedLines) {
+        if (line >= firstLine && !editedAdded) {
+            addEdit(firstLine, firstLine + removedLines, firstLine, firstLine + addedLines);
+            editedAdded = true;
+        }
+        if (line >= firstLine && line < firstLine + addedLines) {
+            continue;
+        }
+        const int oldLine = line < firstLine ? line : line - addedLines + removedLines;
+        addEdit(oldLine, oldLine + 1, line, line + 1);
+    }
+    if (!editedAdded) {
+        addEdit(firstLine, firstLine + removedLines, firstLine, firstLine + addedLines);
+    }
+
+    QVector<int> newLineCounts;
+    newLineCounts.reserve(listing.count());
+    for (int i=0; i<firstLine; i++) {
+        newLineCounts.append(m_outputLineCounts[i]);
+    }
+    for (int i=firstLine; i<firstLine + addedLines; i++) {
+        newLineCounts.append(0);
+    }
+    for (int i=firstLine + removedLines; i<m_outputLineCounts.count(); i++) {
+        newLineCounts.append(m_outputLineCounts[i]);
+    }
+
+    // Go from the bottom, so the output line numbers of the edits above stay valid
+    QTextDocument *document = m_binOutput->document();
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    for (int i=edits.count() - 1; i>=0; i--) {
+        const Edit &edit = edits[i];
+
+        QString text;
+        for (int line=edit.newFirst; line<edit.newLast; line++) {
+            if (listing[line].isEmpty()) {
+                newLineCounts[line] = 0;
+                continue;
+            }
+            newLineCounts[line] = listing[line].count('\n') + 1;
+            text += listing[line] + "\n";
+        }
+
+        const int startLine = edit.oldFirst < m_outputLineNumbers.count() ? m_outputLineNumbers[edit.oldFirst] : m_outputLineCount;
+        const int endLine = edit.oldLast < m_outputLineNumbers.count() ? m_outputLineNumbers[edit.oldLast] : m_outputLineCount;
+        cursor.setPosition(document->findBlockByNumber(startLine).position());
+        cursor.setPosition(document->findBlockByNumber(endLine).position(), QTextCursor::KeepAnchor);
+        cursor.insertText(text);
+    }
+    cursor.endEditBlock();
+
+    m_outputLineCounts = std::move(newLineCounts);
+    m_outputLineNumbers.resize(m_outputLineCounts.count());
+    int outputLineNum = 0;
+    for (int i=0; i<m_outputLineCounts.count(); i++) {
+        m_outputLineNumbers[i] = outputLineNum;
+        outputLineNum += m_outputLineCounts[i];
+    }
+    m_outputLineCount = outputLineNum;
+}
+
+void Editor::updateMemoryContents()
+{
+    const MemoryImage &memory = m_assembler.result().memory;
+
+    // Both are sorted by address, so walk them side by side and collect the runs of lines that differ
+    struct Edit {
+        int oldFirst;
+        int oldLast;
+        QString text;
+    };
+    QVector<Edit> edits;
+
+    uint32_t oldAddress = m_memory.first();
+    uint32_t newAddress = memory.first();
+    int oldLine = 0;
+    while (oldAddress < MemoryImage::Size || newAddress < MemoryImage::Size) {
+        if (oldAddress == newAddress && m_memory.value(oldAddress) == memory.value(newAddress)) {
+            oldAddress = m_memory.next(oldAddress);
+            newAddress = memory.next(newAddress);
+            ++oldLine;
+            continue;
+        }
+
+        if (edits.isEmpty() || edits.last().oldLast != oldLine) {
+            edits.append({oldLine, oldLine, QString()});
+        }
+        Edit &edit = edits.last();
+
+        // Size is past every real address, so a finished side never compares as smaller
+        if (newAddress <= oldAddress) {
+            edit.text += Assembler::memoryLine(newAddress, memory.value(newAddress));
+            if (oldAddress == newAddress) {
+                oldAddress = m_memory.next(oldAddress);
+                ++oldLine;
+                edit.oldLast = oldLine;
+            }
+            newAddress = memory.next(newAddress);
+        } else {
+            oldAddress = m_memory.next(oldAddress);
+            ++oldLine;
+            edit.oldLast = oldLine;
+        }
+    }
+
+    QTextDocument *document = m_memContents->document();
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    for (int i=edits.count() - 1; i>=0; i--) {
+        const Edit &edit = edits[i];
+        cursor.setPosition(document->findBlockByNumber(edit.oldFirst).position());
+        cursor.setPosition(document->findBlockByNumber(edit.oldLast).position(), QTextCursor::KeepAnchor);
+        cursor.insertText(edit.text);
+    }
+    cursor.endEditBlock();
+
+    m_memory = memory;
+    m_emulatorLoaded = false;
+}
+
+void Editor::loadEmulator()
+{
+    m_emulator->load(m_cpu, m_memory);
+    m_emulatorLoaded = true;
+    m_emulatorOutput->clear();
+    m_rateText.clear();
+    m_emulatorTimer->start();
+}
+
+void Editor::onRunClicked(const bool running)
+{
+    updateEmulatorStatus(); // so we don't get confused by something old
+
+    if (running && !m_emulatorLoaded) {
+        loadEmulator();
+    }
+    m_stepButton->setEnabled(!running);
+    m_rateTimer.invalidate();
+    m_emulator->setRunning(running);
+    m_emulatorTimer->start();
+}
+
+void Editor::onStepClicked()
+{
+    if (!m_emulatorLoaded) {
+        loadEmulator();
+    }
+    m_emulator->step();
+    m_emulatorTimer->start();
+}
+
+void Editor::onResetEmulatorClicked()
+{
+    m_runButton->setChecked(false);
+    m_stepButton->setEnabled(true);
+    loadEmulator();
+}
+
+void Editor::onSpeedChanged(const int index)
+{
+    m_rateTimer.invalidate();
+    m_emulator->setSpeed(m_speedSelect->itemData(index).toULongLong());
+}
+
+void Editor::updateEmulatorStatus()
+{
+    EmulatorRunner::Status status;
+    if (!m_emulator->takeStatus(&status)) {
+        return;
+    }
+    const Emulator::State &state = status.state;
+
+    if (!status.outputs.isEmpty()) {
+        QStringList values;
+        for (const Emulator::Output &output : status.outputs) {
+            values.append(QString::number(output.value));
+        }
+        m_emulatorOutput->appendPlainText(values.join('\n'));
+    }
+
+    if (m_runButton->isChecked() && !status.running && status.reason != Emulator::InstructionLimit) {
+        m_runButton->setChecked(false);
+        m_stepButton->setEnabled(true);
+    }
+
+    // Only every now and then, otherwise it's unreadable
+    if (status.running) {
+        if (!m_rateTimer.isValid()) {
+            m_rateTimer.start();
+            m_rateInstructions = state.instructions;
+        } else if (m_rateTimer.elapsed() > 500) {
+            const double seconds = m_rateTimer.restart() / 1000.;
+            m_rateText = QString::asprintf("  %.1f M instructions/s", (state.instructions - m_rateInstructions) / seconds / 1000000.);
+            m_rateInstructions = state.instructions;
+        }
+    } else {
+        m_rateTimer.invalidate();
+        m_rateText.clear();
+    }
+
+    // Nothing more is coming until someone clicks something
+    if (!status.busy) {
+        m_emulatorTimer->stop();
+    }
 
-    QMapIterator<uint32_t, uint8_t> memIterator(m_memory);
-    while (memIterator.hasNext()) {
-        memIterator.next();
-        m_memContents->insertPlainText(QString::asprintf("%.2x %.2x\n", memIterator.key(), memIterator.value()));
+    QString text = QString::asprintf("A %3d  B %3d  PC %3d  %s %s  out %3d  %llu instructions",
+            state.a, state.b, state.pc, state.carry ? "C" : "-", state.zero ? "Z" : "-", state.out,
+            (unsigned long long)state.instructions);
+    text += m_rateText;
+    switch(status.reason) {
+    case Emulator::Halted:
+        text += "  halted";
+        break;
+    case Emulator::InvalidOpcode:
+        text += "  invalid opcode";
+        break;
+    case Emulator::InstructionLimit:
+        break;
+    }
+    if (!m_emulatorLoaded) {
+        text += "  (edited, reset to load the changes)";
     }
+    m_emulatorStatus->setText(text);
+
+    showExecutingLine(m_emulatorLoaded ? m_assembler.lineForAddress(state.pc) : -1);
+}
+
+void Editor::showExecutingLine(const int line)
+{
+    if (line == m_executingLine) {
+        return;
+    }
+    m_executingLine = line;
+    m_asmEdit->setExecutingLine(line);
+
+    if (line < 0 || line >= m_outputLineNumbers.size()) {
+        return;
+    }
+    const int endLine = line + 1 < m_outputLineNumbers.size() ? m_outputLineNumbers[line + 1] : -1;
+    highlightOutput(m_outputLineNumbers[line], endLine);
+    m_binOutput->ensureCursorVisible();
 }
 
 void Editor::onUploadFinished()
@@ -516,9 +879,16 @@ void Editor::onUploadClicked()
 
         m_modem->setBaud(m_baudSelect->currentText().toInt());
         m_modem->setWaveform(AudioBuffer::Waveform(m_waveformSelect->currentIndex()));
+        m_modem->setEncoding(m_encodingSelect->currentIndex());
         m_modem->setVolume(m_volumeSlider->value() / 100.f);
         m_modem->setFrequencies(m_spaceFreq->value(), m_markFreq->value());
 
+        if (!m_modem->tonesFitSampleRate()) {
+            QMessageBox::warning(this, "Baud or frequencies too high", "Some of the tones would be above half the sample rate, so they can't be played.");
+            onUploadFinished();
+            return;
+        }
+
         emit sendData(data);
 
         return;
@@ -563,10 +933,11 @@ bool Editor::loadFile(const QString &path)
         return false;
     }
 
-    QSignalBlocker blocker(m_asmEdit); // don't trigger the save timer
+    // Don't trigger the save timer. The document still tells
+    // onAsmContentsChanged(), so that reassembles it.
+    QSignalBlocker blocker(m_asmEdit);
     m_asmEdit->setPlainText(QString::fromUtf8(content));
     m_asmEdit->updateLineNumberAreaWidth();
-    onAsmChanged();
 
     m_currentFile = path;
     QSettings settings;
@@ -623,6 +994,42 @@ void Editor::onWaveformSelected(int waveform)
     settings.setValue(s_settingsKeyWaveform, waveform);
 }
 
+void Editor::onEncodingSelected(int encoding)
+{
+    if (encoding < 0 || encoding >= AudioBuffer::EncodingCount) {
+        qWarning() << "Invalid encoding" << encoding << "defaulting to Bell 103";
+        encoding = AudioBuffer::Ascii8N1;
+    }
+    m_modem->setEncoding(encoding);
+    QSettings settings;
+    settings.setValue(s_settingsKeyEncoding, encoding);
+
+    updateBaudChoices();
+}
+
+void Editor::updateBaudChoices()
+{
+    // The MFSK tones go up with the baud, so the fast ones don't work with every mode
+    int maxBaud = std::numeric_limits<int>::max();
+    if (!isSerialPort(m_outputSelect->currentText()) && m_modem->audioAvailable()) {
+        maxBaud = m_modem->maxBaud();
+    }
+
+    const QString current = m_baudSelect->currentText();
+    m_baudSelect->clear();
+    for (const int baud : s_baudRates) {
+        if (baud <= maxBaud) {
+            m_baudSelect->addItem(QString::number(baud));
+        }
+    }
+    m_baudSelect->setCurrentText(current);
+
+    if (current.toInt() > maxBaud && m_baudSelect->count() > 0) {
+        m_baudSelect->setCurrentIndex(m_baudSelect->count() - 1);
+        onBaudChanged(m_baudSelect->currentText());
+    }
+}
+
 int Editor::currentLineNumber()
 {
     // holy fuck qt
@@ -713,7 +1120,7 @@ void Editor::onOutputChanged(const QString &outputName)
     } else if (m_modem->audioAvailable()) {
         m_baudSelect->setCurrentText(QString::number(settings.value(s_settingsKeyModemBaudRate, 300).toInt()));
     }
-
+    updateBaudChoices();
 }
 
 void Editor::onBaudChanged(QString baudString)
@@ -818,170 +1225,3 @@ QString Editor::generateTempFilename()
     dir.mkpath(dir.absolutePath());
     return dir.filePath(QDateTime::currentDateTime().toString(Qt::ISODate)) + ".basm";
 }
-
-#define BYTE_TO_BINARY_PATTERN "%c%c%c%c %c%c%c%c"
-#define BYTE_TO_BINARY(byte)  \
-    ((byte) & 0x80 ? '1' : '0'), \
-    ((byte) & 0x40 ? '1' : '0'), \
-    ((byte) & 0x20 ? '1' : '0'), \
-    ((byte) & 0x10 ? '1' : '0'), \
-    ((byte) & 0x08 ? '1' : '0'), \
-    ((byte) & 0x04 ? '1' : '0'), \
-    ((byte) & 0x02 ? '1' : '0'), \
-    ((byte) & 0x01 ? '1' : '0')
-#define NIBBLE_TO_BINARY_PATTERN "%c%c%c%c"
-#define NIBBLE_TO_BINARY(byte)  \
-    ((byte) & 0x08 ? '1' : '0'), \
-    ((byte) & 0x04 ? '1' : '0'), \
-    ((byte) & 0x02 ? '1' : '0'), \
-    ((byte) & 0x01 ? '1' : '0')
-
-QString Editor::parseToBinary(const QString &line, int *num, bool firstPass)
-{
-    const int eol = line.indexOf(';');
-    QStringList tokens = line.mid(0, eol).split(' ', Qt::SkipEmptyParts);
-    if (tokens.isEmpty()) {
-        return "";
-    }
-    QString op = tokens.first().toLower().simplified();
-    if (op.endsWith(":")) {
-        op.chop(1);
-        if (!firstPass) {
-            if (m_usedLabels.contains(op)) {
-                return " ; WARNING: label '" + op + "' already exists\n";
-            }
-            m_usedLabels.insert(op);
-        }
-
-        m_labels[op] = *num;
-        return " ; Label '" + op + "'\n";
-    }
-
-    uint16_t binary = 0;
-    uint32_t address = 0;
-
-    QString helpText;
-    if (op == ".db") {
-        if (tokens.count() < 3) {
-            return "; Syntax: .db address value [label]\n";
-        }
-        bool ok = false;
-        const QString addressString = tokens.takeAt(1);
-
-        if (addressString.startsWith("0x")) {
-            address = (addressString.toInt(&ok, 16));
-        } else {
-            address = (addressString.toInt(&ok));
-        }
-        if (!ok) {
-            return "; Invalid value '" + addressString + "'\n";
-        }
-        if (address > 0xFF) {
-            return "; Address out of range: " + QString::number(address) + "\n";
-        }
-        helpText = QString("Memory content at %1 is %2");
-        if (tokens.count() > 2) {
-            m_labels[tokens[2]] = address;
-            helpText += " (named " + tokens[2] + ")";
-        }
-    } else {
-        if (!m_cpu.operators().contains(op)) {
-            return "; Invalid operator '" + op + "'\n";
-        }
-        if (tokens.count() != m_cpu.operators()[op].numArguments + 1) {
-            return "; Operator '" + op + "' takes " + QString::number(m_cpu.operators()[op].numArguments) + " argument(s)\n";
-        }
-        if (m_cpu.bits() == 8) {
-            binary = m_cpu.operators()[op].opcode << 4;
-            (*num)++;
-        } else {
-            binary = m_cpu.operators()[op].opcode;
-        }
-        address = *num;
-        helpText = m_cpu.operators()[op].help;
-
-    }
-
-    if (tokens.count() > 1) {
-        bool ok = false;
-        uint8_t value = 0;
-        if (m_labels.contains(tokens[1])) {
-            value = m_labels[tokens[1]];
-            ok = true;
-        } else if (tokens[1].startsWith("0x")) {
-            value = (tokens[1].toInt(&ok, 16));
-        } else {
-            value = (tokens[1].toInt(&ok));
-        }
-
-        if (!ok) {
-            return "; Invalid value '" + tokens[1] + "'\n";
-        }
-
-        if (value > 0xF && (m_cpu.bits() == 8 && op != ".db")) {
-            return "; Value out of range: " + QString::number(value) + "\n";
-        }
-
-        if (op == ".db") {
-            helpText = helpText.arg(address).arg(value);
-        } else {
-            helpText = helpText.arg(value);
-        }
-
-        if (m_cpu.bits() == 8) {
-            binary |= value & 0xF;
-        } else {
-            if (op == ".db") {
-                binary |= (value & 0xFF);
-            } else {
-                binary |= (value & 0xFF) << 8;
-            }
-        }
-    }
-
-    QString ret;
-    if (m_cpu.bits() == 16 && op != ".db") {
-        ret = "; " + line.mid(0, eol).simplified() + ": " + helpText + "\n";
-        helpText.clear();
-    }
-    for (int i=0; i<2; i++) {
-        const QByteArray binaryString = QString::asprintf(BYTE_TO_BINARY_PATTERN, BYTE_TO_BINARY(binary & 0xFF)).toLatin1();
-        QByteArray addressString;
-        if (m_cpu.bits() == 8) {
-            addressString = QString::asprintf(NIBBLE_TO_BINARY_PATTERN, NIBBLE_TO_BINARY(address)).toLatin1();
-        } else {
-            addressString = QString::asprintf(BYTE_TO_BINARY_PATTERN, BYTE_TO_BINARY(address)).toLatin1();
-        }
-
-        if (m_memory.contains(address)) {
-            // TODO: track line numbers
-            const QString otherValue = QString::asprintf(BYTE_TO_BINARY_PATTERN, BYTE_TO_BINARY(m_memory[address]));
-            const QString otherAddressBin = QString::asprintf(BYTE_TO_BINARY_PATTERN, BYTE_TO_BINARY(address));
-            helpText +=  " WARNING: overwrites " + otherValue + " at " + otherAddressBin + "!";
-        }
-        m_memory[address] = binary & 0xFF;
-
-        ret += QString::asprintf("%s: %s", addressString.constData(), binaryString.constData());
-
-        if (!helpText.isEmpty()) {
-            ret += "\t; " + helpText;
-        }
-
-        if (op == ".db") {
-            ret += "\n";
-            break;
-        }
-
-        if (m_cpu.bits() == 8) {
-            break;
-        }
-
-        address++;
-        (*num)++;
-        binary >>= 8;
-        //m_memory[address] = binary;
-        ret += "\n";
-    }
-    return ret;
-//    return QString::asprintf("0x%.2x = 0x%.2x \t; %s = %s", address, binary, addressString.constData(), binaryString.constData());
-}
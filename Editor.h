@@ -1,6 +1,7 @@
 #pragma once
 
 #include "CPU.h"
+#include "Assembler.h"
 
 #include <QWidget>
 #include <QHash>
@@ -8,6 +9,9 @@
 #include <QDebug>
 #include <QFocusEvent>
 #include <QKeyEvent>
+#include <QElapsedTimer>
+
+#include <memory>
 
 #include <QComboBox>
 #include <QStylePainter>
@@ -60,7 +64,9 @@ class QSpinBox;
 class QPushButton;
 class QProgressBar;
 class QLabel;
+class QTimer;
 class Modem;
+class EmulatorRunner;
 
 class Editor : public QWidget
 {
@@ -81,6 +87,7 @@ protected:
 
 private slots:
     void onAsmChanged();
+    void onAsmContentsChanged(int position, int charsRemoved, int charsAdded);
     void onUploadClicked();
     void onUploadFinished();
     bool save();
@@ -95,9 +102,15 @@ private slots:
     void onNewFileClicked();
     void setVolume(const int percent);
     void onWaveformSelected(int waveform);
+    void onEncodingSelected(int encoding);
     void updateDevices();
     void onLoadCPUClicked();
     void onEditCPUClicked();
+    void onRunClicked(const bool running);
+    void onStepClicked();
+    void onResetEmulatorClicked();
+    void onSpeedChanged(const int index);
+    void updateEmulatorStatus();
 
 private:
     bool isSerialPort(const QString &name);
@@ -107,14 +120,17 @@ private:
     int currentLineNumber();
     void scrollOutputTo(const int line);
     void highlightOutput(const int firstLine, const int lastLine);
+    void updateOutput(const int firstLine, const int removedLines, const int addedLines, const QVector<int> &changedLines);
+    void updateMemoryContents();
+    void loadEmulator();
+    void showExecutingLine(const int line);
+    void updateBaudChoices();
 
     static QString generateTempFilename();
 
-    QString parseToBinary(const QString &line, int *num, bool firstPass);
-
     CodeTextEdit *m_asmEdit = nullptr;
     QPlainTextEdit *m_binOutput = nullptr;
-    QMap<uint32_t, uint8_t> m_memory; // qmap is sorted
+    MemoryImage m_memory;
     QPlainTextEdit *m_memContents = nullptr;
     DeviceList *m_outputSelect = nullptr;
     QLabel *m_cpuInfoLabel = nullptr;
@@ -125,16 +141,18 @@ private:
 
     QProgressBar *m_progressBar = nullptr;
 
-    QHash<QString, uint32_t> m_labels;
-    QSet<QString> m_usedLabels; // so sue me
     QVector<int> m_outputLineNumbers;
+    QVector<int> m_outputLineCounts; // how many lines of output each line of assembly has
+    int m_outputLineCount = 0;
 
     QString m_currentFile;
 
     CPU m_cpu;
+    Assembler m_assembler { m_cpu };
 
     QComboBox *m_baudSelect;
     QComboBox *m_waveformSelect;
+    QComboBox *m_encodingSelect;
     QSlider *m_volumeSlider;
     QHBoxLayout *m_settingsLayout;
 
@@ -143,4 +161,18 @@ private:
 
     Modem *m_modem;
     QStringList m_serialPorts;
+
+    // Emulator pane
+    std::unique_ptr<EmulatorRunner> m_emulator;
+    bool m_emulatorLoaded = false; // with what's in m_memory
+    QPushButton *m_runButton = nullptr;
+    QPushButton *m_stepButton = nullptr;
+    QComboBox *m_speedSelect = nullptr;
+    QLabel *m_emulatorStatus = nullptr;
+    QPlainTextEdit *m_emulatorOutput = nullptr;
+    QTimer *m_emulatorTimer = nullptr;
+    int m_executingLine = -1;
+    QElapsedTimer m_rateTimer; // for showing how fast it runs
+    uint64_t m_rateInstructions = 0;
+    QString m_rateText;
 };
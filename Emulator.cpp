@@ -0,0 +1,552 @@
+#include "Emulator.h"
+
+#include "TraceRecorder.h"
+
+#include <QHash>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+Emulator::Emulator(const CPU &cpu)
+{
+    if (cpu.bits() == 16) {
+        m_opcodeShift = 0;
+        m_addressMask = 0xFF;
+        m_pcIncrement = 2;
+        m_cyclesPerInstruction = 7; // two extra steps to fetch the operand
+    }
+
+    std::fill(std::begin(m_operations), std::end(m_operations), Operation::Invalid);
+    for (QHash<QString, CPU::Operator>::const_iterator it = cpu.operators().constBegin(); it != cpu.operators().constEnd(); ++it) {
+        m_operations[it->opcode] = operationForName(it.key());
+    }
+
+    memset(m_initialMemory, 0, sizeof m_initialMemory);
+    reset();
+}
+
+Emulator::Operation Emulator::operationForName(const QString &name)
+{
+    static const QHash<QString, Operation> operations = {
+        { "nop", Operation::Nop },
+        { "lda", Operation::Lda },
+        { "add", Operation::Add },
+        { "sub", Operation::Sub },
+        { "sta", Operation::Sta },
+        { "ldi", Operation::Ldi },
+        { "jmp", Operation::Jmp },
+        { "jc", Operation::Jc },
+        { "jz", Operation::Jz },
+        { "addi", Operation::Addi },
+        { "subi", Operation::Subi },
+        { "out", Operation::Out },
+        { "hlt", Operation::Hlt },
+        { "psh", Operation::Psh },
+        { "pop", Operation::Pop },
+        { "jsr", Operation::Jsr },
+        { "rts", Operation::Rts },
+    };
+    return operations.value(name.toLower(), Operation::Invalid);
+}
+
+void Emulator::load(const MemoryImage &memory)
+{
+    memset(m_initialMemory, 0, sizeof m_initialMemory);
+    for (uint32_t address = memory.first(); address <= m_addressMask; address = memory.next(address)) {
+        m_initialMemory[address] = memory.value(address);
+    }
+    reset();
+}
+
+void Emulator::reset()
+{
+    restart();
+
+    m_snapshotStart = 0;
+    m_snapshotCount = 0;
+    if (m_snapshotInterval > 0) {
+        takeSnapshot();
+    }
+}
+
+void Emulator::restart()
+{
+    m_state = State();
+    memcpy(m_memory, m_initialMemory, sizeof m_memory);
+    memset(m_stack, 0, sizeof m_stack);
+    m_outputs.clear();
+    invalidateAll();
+}
+
+void Emulator::clearOutputs()
+{
+    m_outputs.clear();
+
+    // Can't give the old ones back when going back, so start the history over
+    m_snapshotStart = 0;
+    m_snapshotCount = 0;
+    if (m_snapshotInterval > 0) {
+        takeSnapshot();
+    }
+}
+
+void Emulator::setHistory(const int interval, const int capacity)
+{
+    m_snapshotInterval = capacity > 0 ? qMax(interval, 0) : 0;
+    m_snapshots.clear();
+    m_snapshots.resize(m_snapshotInterval > 0 ? capacity : 0);
+    m_snapshotStart = 0;
+    m_snapshotCount = 0;
+    if (m_snapshotInterval > 0) {
+        takeSnapshot();
+    }
+}
+
+void Emulator::takeSnapshot()
+{
+    // Already have it, e.g. when running forward again after going back
+    if (m_snapshotCount > 0 && snapshot(m_snapshotCount - 1).state.instructions >= m_state.instructions) {
+        return;
+    }
+
+    const int capacity = m_snapshots.count();
+    Snapshot &snapshot = m_snapshots[(m_snapshotStart + m_snapshotCount) % capacity];
+    if (m_snapshotCount == capacity) {
+        m_snapshotStart = (m_snapshotStart + 1) % capacity;
+    } else {
+        m_snapshotCount++;
+    }
+
+    snapshot.state = m_state;
+    snapshot.outputCount = m_outputs.count();
+    memcpy(snapshot.memory, m_memory, sizeof snapshot.memory);
+    memcpy(snapshot.stack, m_stack, sizeof snapshot.stack);
+}
+
+void Emulator::restoreSnapshot(const Snapshot &snapshot)
+{
+    m_state = snapshot.state;
+    m_outputs.resize(snapshot.outputCount);
+    memcpy(m_memory, snapshot.memory, sizeof m_memory);
+    memcpy(m_stack, snapshot.stack, sizeof m_stack);
+    invalidateAll();
+}
+
+bool Emulator::seek(const uint64_t instructions)
+{
+    if (instructions < m_state.instructions) {
+        // Newest one that isn't past where we want to go
+        int first = 0;
+        int last = m_snapshotCount - 1;
+        int found = -1;
+        while (first <= last) {
+            const int middle = (first + last) / 2;
+            if (snapshot(middle).state.instructions <= instructions) {
+                found = middle;
+                first = middle + 1;
+            } else {
+                last = middle - 1;
+            }
+        }
+
+        if (found >= 0) {
+            restoreSnapshot(snapshot(found));
+        } else {
+            // Fell out of the history, have to start over
+            restart();
+        }
+    }
+
+    // Don't record the same steps twice
+    TraceRecorder *trace = m_trace;
+    m_trace = nullptr;
+    if (instructions > m_state.instructions) {
+        run(instructions - m_state.instructions);
+    }
+    m_trace = trace;
+
+    return m_state.instructions == instructions;
+}
+
+bool Emulator::stepBack()
+{
+    if (m_state.instructions == 0) {
+        return false;
+    }
+    return seek(m_state.instructions - 1);
+}
+
+void Emulator::decode(const uint8_t address)
+{
+    Decoded &decoded = m_decoded[address];
+    if (m_pcIncrement == 1) {
+        decoded.operation = m_operations[m_memory[address] >> m_opcodeShift];
+        decoded.operand = m_memory[address] & 0xF;
+    } else {
+        decoded.operation = m_operations[m_memory[address]];
+        decoded.operand = m_memory[(address + 1) & m_addressMask];
+    }
+    decoded.nextPc = (address + m_pcIncrement) & m_addressMask;
+}
+
+void Emulator::invalidate(const uint8_t address)
+{
+    m_decoded[address & m_addressMask].operation = Operation::Decode;
+
+    // The operand of the instruction before
+    if (m_pcIncrement == 2) {
+        m_decoded[(address - 1) & m_addressMask].operation = Operation::Decode;
+    }
+}
+
+void Emulator::invalidateAll()
+{
+    for (Decoded &decoded : m_decoded) {
+        decoded.operation = Operation::Decode;
+    }
+}
+
+bool Emulator::step()
+{
+    if (m_state.halted) {
+        return false;
+    }
+
+    const uint8_t pc = m_state.pc;
+    const uint8_t fetched = m_memory[pc];
+    uint8_t opcode, operand;
+    if (m_pcIncrement == 1) {
+        opcode = m_memory[pc] >> m_opcodeShift;
+        operand = m_memory[pc] & 0xF;
+    } else {
+        opcode = m_memory[pc];
+        operand = m_memory[(pc + 1) & m_addressMask];
+    }
+
+    const Operation operation = m_operations[opcode];
+    if (operation == Operation::Invalid) {
+        return false;
+    }
+    int writtenAddress = -1;
+    bool pushed = false;
+
+    m_state.pc = (pc + m_pcIncrement) & m_addressMask;
+    m_state.instructions++;
+    m_state.cycles += m_cyclesPerInstruction;
+
+    // Same as the ALU on the breadboard, subtraction is adding the two's complement
+    auto calculate = [this](const uint8_t value, const bool subtract) {
+        m_state.b = value;
+        const int result = subtract ? m_state.a + uint8_t(~value) + 1 : m_state.a + value;
+        m_state.carry = result > 0xFF;
+        m_state.a = uint8_t(result);
+        m_state.zero = m_state.a == 0;
+    };
+
+    switch(operation) {
+    case Operation::Invalid:
+    case Operation::Decode:
+    case Operation::Nop:
+        break;
+    case Operation::Lda:
+        m_state.a = m_memory[operand & m_addressMask];
+        break;
+    case Operation::Add:
+        calculate(m_memory[operand & m_addressMask], false);
+        break;
+    case Operation::Sub:
+        calculate(m_memory[operand & m_addressMask], true);
+        break;
+    case Operation::Sta:
+        m_memory[operand & m_addressMask] = m_state.a;
+        invalidate(operand);
+        writtenAddress = operand & m_addressMask;
+        break;
+    case Operation::Ldi:
+        m_state.a = operand;
+        break;
+    case Operation::Jmp:
+        m_state.pc = operand & m_addressMask;
+        break;
+    case Operation::Jc:
+        if (m_state.carry) {
+            m_state.pc = operand & m_addressMask;
+        }
+        break;
+    case Operation::Jz:
+        if (m_state.zero) {
+            m_state.pc = operand & m_addressMask;
+        }
+        break;
+    case Operation::Addi:
+        calculate(operand, false);
+        break;
+    case Operation::Subi:
+        calculate(operand, true);
+        break;
+    case Operation::Out:
+        m_state.out = m_state.a;
+        m_outputs.append({m_state.cycles, m_state.a});
+        break;
+    case Operation::Hlt:
+        m_state.halted = true;
+        break;
+    case Operation::Psh:
+        m_stack[--m_state.sp] = m_state.a;
+        pushed = true;
+        break;
+    case Operation::Pop:
+        m_state.a = m_stack[m_state.sp++];
+        break;
+    case Operation::Jsr:
+        m_stack[--m_state.sp] = m_state.pc;
+        m_state.pc = operand & m_addressMask;
+        pushed = true;
+        break;
+    case Operation::Rts:
+        m_state.pc = m_stack[m_state.sp++] & m_addressMask;
+        break;
+    }
+
+    if (m_trace) {
+        m_trace->record(*this, fetched, writtenAddress, pushed, operation == Operation::Out);
+    }
+    if (m_snapshotInterval > 0 && m_state.instructions % m_snapshotInterval == 0) {
+        takeSnapshot();
+    }
+
+    return true;
+}
+
+// With GCC and clang we can jump straight from one handler to the next
+// (threaded code), otherwise it's a normal switch in a loop. The handlers are
+// the same either way.
+#if defined(__GNUC__)
+#define EMULATOR_THREADED_DISPATCH
+#endif
+
+#ifdef EMULATOR_THREADED_DISPATCH
+#define HANDLER(name) handle##name
+#define DISPATCH() \
+    if (remaining-- == 0) { goto limitReached; } \
+    decoded = &m_decoded[pc]; \
+    goto *handlers[int(decoded->operation)]
+#else
+#define HANDLER(name) case Operation::name
+#define DISPATCH() continue
+#endif
+
+#define NEXT() \
+    pc = decoded->nextPc; \
+    instructions++; \
+    DISPATCH()
+
+#define JUMP(target) \
+    pc = (target); \
+    instructions++; \
+    DISPATCH()
+
+#define CALCULATE(value, subtract) { \
+    b = (value); \
+    const int result = (subtract) ? a + uint8_t(~b) + 1 : a + b; \
+    carry = result > 0xFF; \
+    a = uint8_t(result); \
+    zero = a == 0; \
+}
+
+Emulator::StopReason Emulator::run(const uint64_t maxInstructions)
+{
+    if (m_state.halted) {
+        return Halted;
+    }
+
+    if (m_trace) {
+        for (uint64_t i=0; i<maxInstructions; i++) {
+            if (!step()) {
+                return InvalidOpcode;
+            }
+            if (m_state.halted) {
+                return Halted;
+            }
+        }
+        return InstructionLimit;
+    }
+
+    if (m_snapshotInterval == 0) {
+        return runDecoded(maxInstructions);
+    }
+
+    // Stop at every snapshot, so the fast loop doesn't need to know about them
+    uint64_t remaining = maxInstructions;
+    while (remaining > 0) {
+        const uint64_t start = m_state.instructions;
+        const StopReason reason = runDecoded(qMin<uint64_t>(remaining, m_snapshotInterval - start % m_snapshotInterval));
+        remaining -= m_state.instructions - start;
+        if (m_state.instructions % m_snapshotInterval == 0) {
+            takeSnapshot();
+        }
+        if (reason != InstructionLimit) {
+            return reason;
+        }
+    }
+    return InstructionLimit;
+}
+
+Emulator::StopReason Emulator::runDecoded(const uint64_t maxInstructions)
+{
+    // Keep everything in locals so the compiler can keep it in registers
+    uint8_t a = m_state.a;
+    uint8_t b = m_state.b;
+    uint8_t pc = m_state.pc;
+    uint8_t sp = m_state.sp;
+    bool carry = m_state.carry;
+    bool zero = m_state.zero;
+    uint64_t instructions = m_state.instructions;
+    const uint64_t startInstructions = instructions;
+    const uint64_t startCycles = m_state.cycles;
+    uint64_t remaining = maxInstructions;
+    const Decoded *decoded = nullptr;
+    StopReason reason = InstructionLimit;
+
+#ifdef EMULATOR_THREADED_DISPATCH
+    // Same order as Operation
+    static const void *const handlers[] = {
+        &&handleInvalid,
+        &&handleNop,
+        &&handleLda,
+        &&handleAdd,
+        &&handleSub,
+        &&handleSta,
+        &&handleLdi,
+        &&handleJmp,
+        &&handleJc,
+        &&handleJz,
+        &&handleAddi,
+        &&handleSubi,
+        &&handleOut,
+        &&handleHlt,
+        &&handlePsh,
+        &&handlePop,
+        &&handleJsr,
+        &&handleRts,
+        &&handleDecode,
+    };
+    static_assert(sizeof handlers / sizeof handlers[0] == int(Operation::Decode) + 1, "Handlers don't match operations");
+
+    DISPATCH();
+#else
+    for (;;) {
+        if (remaining-- == 0) {
+            goto limitReached;
+        }
+        decoded = &m_decoded[pc];
+        switch(decoded->operation) {
+#endif
+
+    HANDLER(Decode):
+        // Doesn't count as an instruction
+        remaining++;
+        decode(pc);
+        DISPATCH();
+
+    HANDLER(Invalid):
+        reason = InvalidOpcode;
+        goto stopped;
+
+    HANDLER(Nop):
+        NEXT();
+
+    HANDLER(Lda):
+        a = m_memory[decoded->operand];
+        NEXT();
+
+    HANDLER(Add):
+        CALCULATE(m_memory[decoded->operand], false);
+        NEXT();
+
+    HANDLER(Sub):
+        CALCULATE(m_memory[decoded->operand], true);
+        NEXT();
+
+    HANDLER(Sta):
+        m_memory[decoded->operand] = a;
+        invalidate(decoded->operand);
+        NEXT();
+
+    HANDLER(Ldi):
+        a = decoded->operand;
+        NEXT();
+
+    HANDLER(Jmp):
+        JUMP(decoded->operand);
+
+    HANDLER(Jc):
+        if (carry) {
+            JUMP(decoded->operand);
+        }
+        NEXT();
+
+    HANDLER(Jz):
+        if (zero) {
+            JUMP(decoded->operand);
+        }
+        NEXT();
+
+    HANDLER(Addi):
+        CALCULATE(decoded->operand, false);
+        NEXT();
+
+    HANDLER(Subi):
+        CALCULATE(decoded->operand, true);
+        NEXT();
+
+    HANDLER(Out):
+        instructions++;
+        m_state.out = a;
+        m_outputs.append({startCycles + (instructions - startInstructions) * m_cyclesPerInstruction, a});
+        pc = decoded->nextPc;
+        DISPATCH();
+
+    HANDLER(Hlt):
+        pc = decoded->nextPc;
+        instructions++;
+        m_state.halted = true;
+        reason = Halted;
+        goto stopped;
+
+    HANDLER(Psh):
+        m_stack[--sp] = a;
+        NEXT();
+
+    HANDLER(Pop):
+        a = m_stack[sp++];
+        NEXT();
+
+    HANDLER(Jsr):
+        m_stack[--sp] = decoded->nextPc;
+        JUMP(decoded->operand);
+
+    HANDLER(Rts):
+        JUMP(m_stack[sp++] & m_addressMask);
+
+#ifndef EMULATOR_THREADED_DISPATCH
+        }
+    }
+#endif
+
+limitReached:
+    reason = InstructionLimit;
+
+stopped:
+    m_state.a = a;
+    m_state.b = b;
+    m_state.pc = pc;
+    m_state.sp = sp;
+    m_state.carry = carry;
+    m_state.zero = zero;
+    m_state.instructions = instructions;
+    m_state.cycles = startCycles + (instructions - startInstructions) * m_cyclesPerInstruction;
+
+    return reason;
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "CPU.h"
+#include "MemoryImage.h"
+
+#include <QVector>
+
+class TraceRecorder;
+
+// Runs a memory image the way the breadboard computer would, so programs can
+// be tested without uploading them first.
+//
+// What each opcode does is looked up from the operator names in the CPU file,
+// so the opcodes can be shuffled around as long as the names stay the same.
+// With 8 bit instructions we have 16 bytes of memory and a 4 bit operand,
+// with 16 bit instructions 256 bytes and the operand in the second byte.
+class Emulator
+{
+public:
+    enum class Operation : uint8_t {
+        Invalid,
+        Nop,
+        Lda,
+        Add,
+        Sub,
+        Sta,
+        Ldi,
+        Jmp,
+        Jc,
+        Jz,
+        Addi,
+        Subi,
+        Out,
+        Hlt,
+        Psh,
+        Pop,
+        Jsr,
+        Rts,
+
+        Decode // internal, for instructions that haven't been decoded yet
+    };
+
+    enum StopReason {
+        Halted,
+        InstructionLimit,
+        InvalidOpcode
+    };
+
+    struct State
+    {
+        uint8_t a = 0;
+        uint8_t b = 0;
+        uint8_t pc = 0;
+        uint8_t sp = 0; // grows down, separate from the normal memory
+        uint8_t out = 0;
+        bool carry = false;
+        bool zero = false;
+        bool halted = false;
+
+        uint64_t cycles = 0; // clock cycles, every instruction goes through all its steps
+        uint64_t instructions = 0;
+    };
+
+    struct Output
+    {
+        uint64_t cycle = 0;
+        uint8_t value = 0;
+    };
+
+    explicit Emulator(const CPU &cpu);
+
+    // Copies the part of the image the CPU can address, and resets
+    void load(const MemoryImage &memory);
+    void reset();
+
+    // Executes a single instruction, returns false if it couldn't
+    bool step();
+
+    // Much faster than step(), the instructions are decoded once and then
+    // dispatched directly to their handler. If a sta writes over code the
+    // instructions there are decoded again the next time they run.
+    StopReason run(const uint64_t maxInstructions);
+
+    const State &state() const { return m_state; }
+    uint8_t memory(const uint8_t address) const { return m_memory[address & m_addressMask]; }
+    int memorySize() const { return m_addressMask + 1; }
+    uint8_t stack(const uint8_t address) const { return m_stack[address]; }
+
+    // Everything written by out since the last reset
+    const QVector<Output> &outputs() const { return m_outputs; }
+
+    // For long runs, when the outputs have been dealt with. Also clears the
+    // history, we can't go back past this.
+    void clearOutputs();
+
+    // Keeps a snapshot of the whole machine every interval instructions, up
+    // to capacity of them (the oldest are dropped), so we can go backwards by
+    // restoring the closest one and running forward from there. An interval
+    // of 0 turns it off. Clears what was there before.
+    void setHistory(const int interval, const int capacity);
+    int snapshotCount() const { return m_snapshotCount; }
+
+    // Goes to the state after the given number of instructions, backwards or
+    // forwards. Returns false if the program stopped before getting there.
+    bool seek(const uint64_t instructions);
+    bool stepBack();
+
+    // Records every step until set back to nullptr. run() goes through
+    // step() while recording, so it's a lot slower.
+    void setTraceRecorder(TraceRecorder *recorder) { m_trace = recorder; }
+
+    static Operation operationForName(const QString &name);
+
+    // How the CPU decodes things, for BatchEmulator
+    Operation operation(const uint8_t opcode) const { return m_operations[opcode]; }
+    uint8_t addressMask() const { return m_addressMask; }
+    int instructionSize() const { return m_pcIncrement; }
+    int cyclesPerInstruction() const { return m_cyclesPerInstruction; }
+
+private:
+    struct Decoded
+    {
+        Operation operation = Operation::Decode;
+        uint8_t operand = 0;
+        uint8_t nextPc = 0;
+    };
+
+    // Everything needed to get back to a point in time
+    struct Snapshot
+    {
+        State state;
+        int outputCount = 0;
+        uint8_t memory[256];
+        uint8_t stack[256];
+    };
+
+    StopReason runDecoded(const uint64_t maxInstructions);
+
+    void decode(const uint8_t address);
+    void invalidate(const uint8_t address);
+    void invalidateAll();
+
+    void restart();
+    void takeSnapshot();
+    void restoreSnapshot(const Snapshot &snapshot);
+    const Snapshot &snapshot(const int index) const { return m_snapshots[(m_snapshotStart + index) % m_snapshots.count()]; }
+
+    Operation m_operations[256];
+    uint8_t m_opcodeShift = 4;
+    uint8_t m_addressMask = 0xF;
+    uint8_t m_pcIncrement = 1;
+    uint8_t m_cyclesPerInstruction = 5;
+
+    State m_state;
+    uint8_t m_memory[256];
+    uint8_t m_initialMemory[256];
+    uint8_t m_stack[256];
+    Decoded m_decoded[256]; // one for each address we can jump to
+
+    QVector<Output> m_outputs;
+
+    TraceRecorder *m_trace = nullptr;
+
+    // Ring buffer, allocated up front
+    QVector<Snapshot> m_snapshots;
+    int m_snapshotStart = 0;
+    int m_snapshotCount = 0;
+    int m_snapshotInterval = 0;
+};
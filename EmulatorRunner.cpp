@@ -0,0 +1,176 @@
+#include "EmulatorRunner.h"
+
+#include <QElapsedTimer>
+
+#include <chrono>
+
+namespace {
+// Short enough that the UI sees changes right away, long enough that locking
+// doesn't matter at full speed
+constexpr uint64_t s_sliceInstructions = 100000;
+} // namespace
+
+EmulatorRunner::EmulatorRunner()
+{
+    m_thread = std::thread(&EmulatorRunner::work, this);
+}
+
+EmulatorRunner::~EmulatorRunner()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+void EmulatorRunner::load(const CPU &cpu, const MemoryImage &memory)
+{
+    // Set up here, the CPU can change under the worker's feet
+    std::unique_ptr<Emulator> emulator(new Emulator(cpu));
+    emulator->load(memory);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingEmulator = std::move(emulator);
+        m_running = false;
+        m_pendingSteps = 0;
+    }
+    m_condition.notify_all();
+}
+
+void EmulatorRunner::setRunning(const bool running)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = running;
+        m_status.running = running;
+        m_changed = true;
+    }
+    m_condition.notify_all();
+}
+
+void EmulatorRunner::step()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingSteps++;
+    }
+    m_condition.notify_all();
+}
+
+void EmulatorRunner::setSpeed(const uint64_t instructionsPerSecond)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_speed = instructionsPerSecond;
+    }
+    m_condition.notify_all();
+}
+
+bool EmulatorRunner::takeStatus(Status *status)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_changed) {
+        return false;
+    }
+    *status = m_status;
+    status->busy = m_running || m_working || m_pendingSteps > 0 || m_pendingEmulator;
+    m_status.outputs.clear();
+    m_changed = false;
+    return true;
+}
+
+void EmulatorRunner::publish(const Emulator &emulator, const Emulator::StopReason reason)
+{
+    m_status.state = emulator.state();
+    m_status.reason = reason;
+    m_status.loaded = true;
+    m_status.running = m_running;
+
+    const QVector<Emulator::Output> &outputs = emulator.outputs();
+    const int first = qMax(0, outputs.count() - MaxPendingOutputs);
+    for (int i=first; i<outputs.count(); i++) {
+        m_status.outputs.append(outputs[i]);
+    }
+    if (m_status.outputs.count() > MaxPendingOutputs) {
+        m_status.outputs.remove(0, m_status.outputs.count() - MaxPendingOutputs);
+    }
+
+    m_changed = true;
+}
+
+void EmulatorRunner::work()
+{
+    std::unique_ptr<Emulator> emulator;
+    Emulator::StopReason reason = Emulator::InstructionLimit;
+
+    // For keeping the speed, how many we've run since we started timing
+    QElapsedTimer timer;
+    uint64_t timedInstructions = 0;
+    uint64_t timedSpeed = 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_quit) {
+        m_condition.wait(lock, [this]() {
+            return m_quit || m_pendingEmulator || m_pendingSteps > 0 || m_running;
+        });
+        if (m_quit) {
+            break;
+        }
+
+        if (m_pendingEmulator) {
+            emulator = std::move(m_pendingEmulator);
+            reason = Emulator::InstructionLimit;
+            m_status.outputs.clear();
+            publish(*emulator, reason);
+        }
+        if (!emulator) {
+            m_pendingSteps = 0;
+            m_running = false;
+            continue;
+        }
+
+        uint64_t count = 0;
+        if (m_running) {
+            if (!timer.isValid() || timedSpeed != m_speed) {
+                timer.start();
+                timedInstructions = 0;
+                timedSpeed = m_speed;
+            }
+            count = s_sliceInstructions;
+            if (m_speed > 0) {
+                const uint64_t target = uint64_t(timer.nsecsElapsed() / 1e9 * m_speed);
+                if (target <= timedInstructions) {
+                    // Sleep until the next one is due, commands still wake us up
+                    const int64_t due = int64_t((timedInstructions + 1) * 1e9 / m_speed);
+                    m_condition.wait_for(lock, std::chrono::nanoseconds(qMax<int64_t>(due - timer.nsecsElapsed(), 0)));
+                    continue;
+                }
+                count = qMin(count, target - timedInstructions);
+            }
+        } else {
+            timer.invalidate();
+            count = m_pendingSteps;
+            m_pendingSteps = 0;
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        m_working = true;
+        lock.unlock();
+        const uint64_t before = emulator->state().instructions;
+        reason = emulator->run(count);
+        timedInstructions += emulator->state().instructions - before;
+        lock.lock();
+        m_working = false;
+
+        if (reason != Emulator::InstructionLimit) {
+            m_running = false;
+        }
+        publish(*emulator, reason);
+        emulator->clearOutputs(); // sent, no point in keeping them around
+    }
+}
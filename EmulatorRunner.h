@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Emulator.h"
+
+#include <QVector>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Runs the emulator on its own thread for the editor, so running at full
+// speed doesn't block the UI.
+//
+// The worker runs in short slices and stores the latest state after each
+// one, the UI picks it up with takeStatus() at its own pace (e.g. once per
+// frame), so however fast the program runs the UI only sees one update per
+// frame.
+class EmulatorRunner
+{
+public:
+    struct Status
+    {
+        Emulator::State state;
+        Emulator::StopReason reason = Emulator::InstructionLimit;
+        bool loaded = false;
+        bool running = false;
+        bool busy = false; // if not, nothing changes until we're told to do something
+
+        // Written since the last takeStatus(), only the newest if there's a lot
+        QVector<Emulator::Output> outputs;
+    };
+
+    static constexpr int MaxPendingOutputs = 1000;
+
+    EmulatorRunner();
+    ~EmulatorRunner();
+
+    // Stops and starts over with a new program
+    void load(const CPU &cpu, const MemoryImage &memory);
+
+    void setRunning(const bool running);
+    void step();
+
+    // Instructions per second, 0 runs as fast as possible
+    void setSpeed(const uint64_t instructionsPerSecond);
+
+    // Returns false if nothing happened since the last call
+    bool takeStatus(Status *status);
+
+private:
+    void work();
+    void publish(const Emulator &emulator, const Emulator::StopReason reason);
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+
+    // Set by the UI, picked up by the worker between slices
+    std::unique_ptr<Emulator> m_pendingEmulator;
+    bool m_running = false;
+    int m_pendingSteps = 0;
+    uint64_t m_speed = 0;
+    bool m_quit = false;
+
+    // Set by the worker
+    Status m_status;
+    bool m_working = false; // running instructions without the lock
+    bool m_changed = false;
+};
@@ -0,0 +1,53 @@
+#include "MemoryImage.h"
+
+#include <QtAlgorithms>
+
+void MemoryImage::remove(const uint32_t address)
+{
+    if (!contains(address)) {
+        return;
+    }
+    m_occupied[address / 64] &= ~(1ull << (address % 64));
+    m_count--;
+}
+
+void MemoryImage::clear()
+{
+    // The values are never read unless the bit is set, so no need to touch them
+    memset(m_occupied, 0, sizeof m_occupied);
+    m_count = 0;
+}
+
+uint32_t MemoryImage::findFrom(const uint32_t address) const
+{
+    if (address >= Size) {
+        return Size;
+    }
+
+    uint32_t index = address / 64;
+    uint64_t word = m_occupied[index] & (~0ull << (address % 64));
+    while (!word) {
+        index++;
+        if (index >= Size / 64) {
+            return Size;
+        }
+        word = m_occupied[index];
+    }
+    return index * 64 + qCountTrailingZeroBits(quint64(word));
+}
+
+bool MemoryImage::operator==(const MemoryImage &other) const
+{
+    if (m_count != other.m_count) {
+        return false;
+    }
+    if (memcmp(m_occupied, other.m_occupied, sizeof m_occupied) != 0) {
+        return false;
+    }
+    for (uint32_t address = first(); address < Size; address = next(address)) {
+        if (m_values[address] != other.m_values[address]) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Flat memory image with a bitmap of which addresses have been written, so
+// looking up, writing and walking it in order doesn't need any allocations.
+//
+// Sized for 8 bit addresses, which is the most any of the machines can reach,
+// CPU::addressCount() says how much of it a given one actually has.
+class MemoryImage
+{
+public:
+    static constexpr uint32_t Size = 0x100;
+
+    MemoryImage() { clear(); }
+
+    bool contains(const uint32_t address) const {
+        return address < Size && (m_occupied[address / 64] & (1ull << (address % 64)));
+    }
+
+    // Only meaningful if contains() is true
+    uint8_t value(const uint32_t address) const {
+        return m_values[address];
+    }
+
+    // Address must be inside the image
+    void set(const uint32_t address, const uint8_t value) {
+        uint64_t &word = m_occupied[address / 64];
+        const uint64_t bit = 1ull << (address % 64);
+        if (!(word & bit)) {
+            word |= bit;
+            m_count++;
+        }
+        m_values[address] = value;
+    }
+
+    void remove(const uint32_t address);
+    void clear();
+
+    int count() const { return m_count; }
+    bool isEmpty() const { return m_count == 0; }
+
+    // For walking the used addresses in order:
+    // for (uint32_t address = image.first(); address < MemoryImage::Size; address = image.next(address))
+    uint32_t first() const { return findFrom(0); }
+    uint32_t next(const uint32_t address) const { return findFrom(address + 1); }
+
+    bool operator==(const MemoryImage &other) const;
+    bool operator!=(const MemoryImage &other) const { return !(*this == other); }
+
+private:
+    uint32_t findFrom(const uint32_t address) const;
+
+    uint64_t m_occupied[Size / 64];
+    uint8_t m_values[Size];
+    int m_count = 0;
+};
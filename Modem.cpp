@@ -4,7 +4,9 @@
 
 #include <QDebug>
 #include <cmath>
+#include <iterator>
 #include <QThread>
+#include <QTimer>
 #include <QCoreApplication>
 
 #define MA_NO_JACK
@@ -16,11 +18,23 @@
 #define DEFAULT_SAMPLERATE  44100
 
 Modem::Modem(QObject *parent) : QObject(parent),
-    m_device(nullptr, &Modem::freeDevice)
+    m_device(nullptr, &Modem::freeDevice),
+    m_captureDevice(nullptr, &Modem::freeDevice)
 {
     Q_ASSERT(QThread::currentThread() == qApp->thread());
 
     m_buffer = std::make_unique<AudioBuffer>();
+
+    // Polls the audio callback's progress, so it doesn't have to emit
+    // anything from the audio thread
+    m_progressTimer = new QTimer(this);
+    m_progressTimer->setInterval(50);
+    connect(m_progressTimer, &QTimer::timeout, this, &Modem::updateProgress);
+
+    m_captureTimer = new QTimer(this);
+    m_captureTimer->setInterval(20);
+    connect(m_captureTimer, &QTimer::timeout, this, &Modem::processCaptured);
+
     m_maContext = std::make_unique<ma_context>();
     ma_result ret = ma_context_init(nullptr, 0, nullptr, m_maContext.get());
     if (ret != MA_SUCCESS) {
@@ -36,6 +50,8 @@ Modem::~Modem()
 {
     Q_ASSERT(QThread::currentThread() == qApp->thread());
 
+    stopListening();
+
     if (m_maContext) {
         ma_context_uninit(m_maContext.get());
     }
@@ -43,19 +59,23 @@ Modem::~Modem()
     std::lock_guard<std::recursive_mutex> lock(m_maMutex);
 }
 
-static bool getDeviceInfo(ma_context *context, const QByteArray &name, ma_device_info *info)
+static bool getDeviceInfo(ma_context *context, const QByteArray &name, const ma_device_type type, ma_device_info *info)
 {
-    ma_device_info* devicesInfo;
-    ma_uint32 devicesCount;
-    if (ma_context_get_devices(context, &devicesInfo, &devicesCount, nullptr, nullptr) != MA_SUCCESS) {
+    ma_device_info* playbackInfo;
+    ma_uint32 playbackCount;
+    ma_device_info* captureInfo;
+    ma_uint32 captureCount;
+    if (ma_context_get_devices(context, &playbackInfo, &playbackCount, &captureInfo, &captureCount) != MA_SUCCESS) {
         return false;
     }
+    ma_device_info *devicesInfo = type == ma_device_type_capture ? captureInfo : playbackInfo;
+    const ma_uint32 devicesCount = type == ma_device_type_capture ? captureCount : playbackCount;
 
     for (size_t i=0; i<devicesCount; i++) {
         if (devicesInfo[i].name != name) {
             continue;
         }
-        if (ma_context_get_device_info(context, ma_device_type_playback, &devicesInfo[i].id, ma_share_mode_shared, info) == MA_SUCCESS) {
+        if (ma_context_get_device_info(context, type, &devicesInfo[i].id, ma_share_mode_shared, info) == MA_SUCCESS) {
             return true;
         }
         // Idk, maybe there are more with the same name?
@@ -122,7 +142,7 @@ bool Modem::initAudio(const QString &deviceName)
     deviceConfig.sampleRate        = DEFAULT_SAMPLERATE;
 
     ma_device_info deviceInfo;
-    if (!deviceName.isEmpty() && getDeviceInfo(m_maContext.get(), deviceName.toLocal8Bit(), &deviceInfo)) {
+    if (!deviceName.isEmpty() && getDeviceInfo(m_maContext.get(), deviceName.toLocal8Bit(), ma_device_type_playback, &deviceInfo)) {
         deviceConfig.playback.pDeviceID = &deviceInfo.id;
 //        if (deviceInfo.formatCount > 0) {
 //            deviceConfig.playback.format = deviceInfo.formats[0];
@@ -154,23 +174,60 @@ void Modem::send(const QByteArray &bytes)
 {
     Q_ASSERT(QThread::currentThread() == qApp->thread());
 
-    std::unique_lock<std::recursive_mutex> lock(m_maMutex);
     if (!m_device) {
         qWarning() << "No device available, refusing to fill buffer";
         return;
     }
 
-    const bool wasEmpty = m_buffer->isEmpty();
-    for (int i=0; i<bytes.count(); i++) {
-        m_buffer->appendBytes(bytes.mid(i, 1));
+    if (!m_isActive) {
+        if (!m_buffer->tonesFitSampleRate()) {
+            qWarning() << "Tones too high for the sample rate, refusing to send" << m_buffer->highestFrequency() << m_buffer->sampleRate;
+            emit stopped();
+            return;
+        }
+
+        // Nothing is playing, so it's safe to touch the buffer
+        m_buffer->prepare();
+        m_framesPlayedBefore = m_buffer->framesPlayed();
+        m_framesToSend = 0;
     }
-    m_framesToSend = m_buffer->frameCount();
+    m_framesToSend += m_buffer->framesForBytes(bytes.count());
+
+    // Just queued, the audio is generated in the callback as it plays. What
+    // doesn't fit is topped up as the queue drains.
+    m_pendingBytes.append(bytes);
+    queuePending();
 
-    lock.unlock();
-    if (wasEmpty && !ma_device_is_started(m_device.get())) {
+    if (!ma_device_is_started(m_device.get())) {
         ma_device_start(m_device.get());
     }
     m_isActive = true;
+    m_progressTimer->start();
+}
+
+void Modem::queuePending()
+{
+    if (m_pendingBytes.isEmpty()) {
+        return;
+    }
+    m_pendingBytes.remove(0, m_buffer->appendBytes(m_pendingBytes));
+}
+
+void Modem::updateProgress()
+{
+    Q_ASSERT(QThread::currentThread() == qApp->thread());
+
+    queuePending();
+
+    if (m_pendingBytes.isEmpty() && m_buffer->isFinished()) {
+        m_progressTimer->stop();
+        emit progress(100);
+        emit finished();
+        return;
+    }
+
+    const int64_t played = m_buffer->framesPlayed() - m_framesPlayedBefore;
+    emit progress(int(qBound<int64_t>(0, 100 * played / qMax<int64_t>(m_framesToSend, 1), 99)));
 }
 
 void Modem::sendHex(const QByteArray &encoded)
@@ -184,13 +241,16 @@ void Modem::stop()
 {
     Q_ASSERT(QThread::currentThread() == qApp->thread());
 
+    // Waits for the callback to finish, so after this we're the only ones
+    // touching the buffer
     ma_device_stop(m_device.get());
+    m_progressTimer->stop();
 
     m_isActive = false;
 
     emit stopped();
 
-    std::lock_guard<std::recursive_mutex> lock(m_maMutex);
+    m_pendingBytes.clear();
     m_buffer->clear();
 }
 
@@ -212,7 +272,9 @@ void Modem::updateAudioDevices()
 
     ma_device_info* devicesInfo;
     ma_uint32 devicesCount;
-    ma_result ret = ma_context_get_devices(m_maContext.get(), &devicesInfo, &devicesCount, nullptr, nullptr);
+    ma_device_info* captureInfo;
+    ma_uint32 captureCount;
+    ma_result ret = ma_context_get_devices(m_maContext.get(), &devicesInfo, &devicesCount, &captureInfo, &captureCount);
     if (ret != MA_SUCCESS) {
         qWarning() << "Failed to get list of devices";
         return;
@@ -228,6 +290,16 @@ void Modem::updateAudioDevices()
             m_outputDeviceList.append(name);
         }
     }
+
+    m_inputDeviceList.clear();
+    for (size_t i=0; i<captureCount; i++) {
+        const QString name = QString::fromLocal8Bit(captureInfo[i].name);
+        if (captureInfo[i].isDefault) {
+            m_inputDeviceList.prepend(name);
+        } else {
+            m_inputDeviceList.append(name);
+        }
+    }
     emit devicesUpdated(m_outputDeviceList);
 }
 
@@ -237,6 +309,7 @@ void Modem::setBaud(const int baud)
         return;
     }
     m_buffer->baud = baud;
+    setupDemodulator();
 }
 
 void Modem::setSampleRate(const int /*rate*/)
@@ -254,6 +327,7 @@ void Modem::setFrequencies(const int space, const int mark)
 
     m_buffer->spaceFrequency = space;
     m_buffer->markFrequency = mark;
+    setupDemodulator();
 }
 
 void Modem::setVolume(const float volume)
@@ -278,20 +352,132 @@ void Modem::setWaveform(int waveform)
     m_buffer->waveform = AudioBuffer::Waveform(waveform);
 }
 
+AudioBuffer::Encoding Modem::currentEncoding() const
+{
+    return m_buffer->m_encoding;
+}
+
+void Modem::setEncoding(int encoding)
+{
+    Q_ASSERT(QThread::currentThread() == qApp->thread());
+    if (encoding < 0 || encoding >= AudioBuffer::EncodingCount) {
+        qWarning() << "Invalid encoding" << encoding << "defaulting to Bell 103";
+        encoding = AudioBuffer::Ascii8N1;
+    }
+    if (m_isActive) {
+        qWarning() << "Can't change the encoding while sending";
+        return;
+    }
+    m_buffer->m_encoding = AudioBuffer::Encoding(encoding);
+    setupDemodulator();
+}
+
 void Modem::maDataCallback(ma_device *device, void *output, const void *input, uint32_t frameCount)
 {
     Q_UNUSED(input);
 
+    // Real-time thread, so no locking, allocating or emitting in here,
+    // updateProgress() picks up how far we've come
     Modem *that = reinterpret_cast<Modem*>(device->pUserData);
-    std::lock_guard<std::recursive_mutex> lock(that->m_maMutex);
-
     that->m_buffer->takeFrames(frameCount, output);
+}
+
+bool Modem::startListening(const QString &deviceName)
+{
+    Q_ASSERT(QThread::currentThread() == qApp->thread());
 
-    if (that->m_buffer->isEmpty()) {
-        emit that->progress(100);
-        emit that->finished();
-    } else {
-        emit that->progress(100 - (100 * that->m_buffer->frameCount() / that->m_framesToSend));
+    stopListening();
+
+    if (!m_maContext) {
+        qWarning() << "No context available";
+        return false;
+    }
+
+    ma_device_config deviceConfig = ma_device_config_init(ma_device_type_capture);
+    deviceConfig.capture.channels = 1;
+    deviceConfig.capture.format   = DEFAULT_FORMAT;
+    deviceConfig.sampleRate       = DEFAULT_SAMPLERATE;
+    deviceConfig.dataCallback     = &Modem::maCaptureCallback;
+    deviceConfig.pUserData        = this;
+
+    ma_device_info deviceInfo;
+    if (!deviceName.isEmpty()) {
+        if (!getDeviceInfo(m_maContext.get(), deviceName.toLocal8Bit(), ma_device_type_capture, &deviceInfo)) {
+            qWarning() << "Invalid input device" << deviceName;
+            return false;
+        }
+        deviceConfig.capture.pDeviceID = &deviceInfo.id;
+    }
+
+    std::unique_ptr<ma_device, decltype(&Modem::freeDevice)> device(new ma_device, &Modem::freeDevice);
+    if (ma_device_init(m_maContext.get(), &deviceConfig, device.get()) != MA_SUCCESS) {
+        qWarning() << "Failed to init capture device";
+        delete device.release(); // never inited, so don't uninit
+        return false;
+    }
+
+    m_captured.clear();
+    m_capturedDropped = 0;
+    m_capturedDroppedReported = 0;
+    m_captureDevice = std::move(device);
+    setupDemodulator();
+
+    if (ma_device_start(m_captureDevice.get()) != MA_SUCCESS) {
+        qWarning() << "Failed to start capture device";
+        m_captureDevice.reset();
+        return false;
+    }
+    m_captureTimer->start();
+    return true;
+}
+
+void Modem::stopListening()
+{
+    Q_ASSERT(QThread::currentThread() == qApp->thread());
+
+    m_captureTimer->stop();
+    m_captureDevice.reset(); // stops it and waits for the callback
+}
+
+void Modem::setupDemodulator()
+{
+    if (!m_captureDevice) {
+        return;
+    }
+    m_demodulator.setup(*m_buffer, int(m_captureDevice->sampleRate));
+}
+
+void Modem::processCaptured()
+{
+    Q_ASSERT(QThread::currentThread() == qApp->thread());
+
+    float samples[4096];
+    size_t count;
+    while ((count = m_captured.pop(samples, std::size(samples))) > 0) {
+        m_demodulator.process(samples, count);
+    }
+
+    const int64_t dropped = m_capturedDropped.load(std::memory_order_relaxed);
+    if (dropped != m_capturedDroppedReported) {
+        qWarning() << "Dropped" << (dropped - m_capturedDroppedReported) << "captured samples, we're not keeping up";
+        m_capturedDroppedReported = dropped;
+    }
+
+    const QByteArray bytes = m_demodulator.takeBytes();
+    if (!bytes.isEmpty()) {
+        emit received(bytes);
+    }
+}
+
+void Modem::maCaptureCallback(ma_device *device, void *output, const void *input, uint32_t frameCount)
+{
+    Q_UNUSED(output);
+
+    // Real-time thread again, just hand the samples over
+    Modem *that = reinterpret_cast<Modem*>(device->pUserData);
+    const size_t pushed = that->m_captured.push(reinterpret_cast<const float*>(input), frameCount);
+    if (pushed < frameCount) {
+        that->m_capturedDropped.fetch_add(int64_t(frameCount - pushed), std::memory_order_relaxed);
     }
 }
 
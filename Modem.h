@@ -1,18 +1,23 @@
 #pragma once
 
 #include "AudioBuffer.h"
+#include "Demodulator.h"
+#include "RingBuffer.h"
 
 #include <QObject>
 #include <QElapsedTimer>
 #include <QHash>
 #include <QDebug>
 
+#include <atomic>
 #include <memory>
 #include <mutex>
 
 struct ma_device;
 struct ma_context;
 
+class QTimer;
+
 class Modem : public QObject
 {
     Q_OBJECT
@@ -26,13 +31,28 @@ public:
     bool isInitialized() const { return m_device != nullptr; }
 
     QStringList audioOutputDevices();
+    QStringList audioInputDevices() const { return m_inputDeviceList; }
+
+    // Decodes what comes in on an input device with the same settings we
+    // send with, and emits received() with the bytes
+    bool startListening(const QString &deviceName = "");
+    void stopListening();
+    bool isListening() const { return m_captureDevice != nullptr; }
 
+    // Settings only take effect with the next send, the audio callback
+    // works from a copy made when it starts
     void setBaud(const int baud);
     void setSampleRate(const int rate);
     void setFrequencies(const int space, const int mark);
     void setVolume(const float volume);
     void setWaveform(int waveform);
     AudioBuffer::Waveform currentWaveform() const;
+    void setEncoding(int encoding);
+    AudioBuffer::Encoding currentEncoding() const;
+
+    // If not, send() refuses
+    bool tonesFitSampleRate() const { return m_buffer->tonesFitSampleRate(); }
+    int maxBaud() const { return m_buffer->maxBaud(); }
 
     bool isActive() const { return m_isActive; }
 
@@ -48,11 +68,18 @@ signals:
     void finished();
     void devicesUpdated(const QStringList devices);
     void progress(int percent);
+    void received(const QByteArray &bytes);
 
 private:
+    void queuePending();
+    void updateProgress();
+    void setupDemodulator();
+    void processCaptured();
+
     static void freeDevice(ma_device *dev);
     static void maDataCallback(ma_device* device, void *output, const void *input, uint32_t frameCount);
     static void maStoppedCallback(ma_device *device);
+    static void maCaptureCallback(ma_device* device, void *output, const void *input, uint32_t frameCount);
 
     std::unique_ptr<ma_context> m_maContext;
     std::unique_ptr<ma_device, decltype(&Modem::freeDevice)> m_device;
@@ -63,11 +90,26 @@ private:
 
     QString m_currentDevice;
 
+    // Shared with the audio callback through its lock free queue, the
+    // callback never locks anything
     std::unique_ptr<AudioBuffer> m_buffer;
+    QByteArray m_pendingBytes; // didn't fit in the queue yet
+    QTimer *m_progressTimer = nullptr;
+
+    // Same deal the other way around, the capture callback only pushes the
+    // samples and they're decoded on our thread
+    std::unique_ptr<ma_device, decltype(&Modem::freeDevice)> m_captureDevice;
+    RingBuffer<float> m_captured{1 << 17};
+    std::atomic<int64_t> m_capturedDropped{0};
+    int64_t m_capturedDroppedReported = 0;
+    Demodulator m_demodulator;
+    QTimer *m_captureTimer = nullptr;
 
     QStringList m_outputDeviceList;
+    QStringList m_inputDeviceList;
     bool m_isActive = false;
 
-    int m_framesToSend = 0;
+    int64_t m_framesToSend = 0;
+    int64_t m_framesPlayedBefore = 0; // when this send started
 };
 
@@ -0,0 +1,294 @@
+#include "AudioBuffer.h"
+#include "ChannelSimulator.h"
+#include "Demodulator.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDateTime>
+
+#include <algorithm>
+#include <bitset>
+#include <cstdio>
+#include <iterator>
+#include <math.h>
+#include <random>
+
+// Sends random bytes through the modulator, a simulated soundcard and the
+// demodulator for every combination of encoding, baud, waveform and volume, and prints
+// the bit error rate and how long modulating and demodulating took. Use it
+// to pick the fastest baud that's safe with a given soundcard, and with
+// --json to keep the numbers around to compare against.
+
+namespace {
+
+const char *s_waveformNames[] = { "square", "sawtooth", "triangle", "sine" };
+static_assert(std::size(s_waveformNames) == AudioBuffer::WaveformCount, "Missing waveform names");
+
+struct Result
+{
+    int64_t bits = 0;
+    int64_t bitErrors = 0;
+    int bytesReceived = 0;
+    int64_t framingErrors = 0;
+    ChannelSimulator::Timings timings;
+
+    double bitErrorRate() const { return bits ? double(bitErrors) / bits : 0.; }
+};
+
+// Missing or extra bytes at the end count as all their bits wrong
+int64_t countBitErrors(const QByteArray &sent, const QByteArray &received)
+{
+    int64_t errors = 8 * qAbs(sent.count() - received.count());
+    for (int i=0; i<qMin(sent.count(), received.count()); i++) {
+        errors += std::bitset<8>(uint8_t(sent[i] ^ received[i])).count();
+    }
+    return errors;
+}
+
+Result runBenchmark(AudioBuffer *modulator, ChannelSimulator *channel, const QByteArray &bytes)
+{
+    modulator->clear();
+    modulator->prepare();
+    channel->inputSampleRate = modulator->sampleRate;
+    channel->reset();
+
+    Demodulator demodulator;
+    demodulator.setup(*modulator, channel->outputSampleRate);
+
+    Result result;
+    const QByteArray received = channel->loopback(modulator, &demodulator, bytes, &result.timings);
+
+    result.bits = 8 * int64_t(bytes.count());
+    result.bitErrors = countBitErrors(bytes, received);
+    result.bytesReceived = received.count();
+    result.framingErrors = demodulator.framingErrors();
+    return result;
+}
+
+// Comma separated
+template<typename T, typename Convert>
+bool parseList(const QString &text, QVector<T> *values, const Convert &convert)
+{
+    for (const QString &value : text.split(',', Qt::SkipEmptyParts)) {
+        bool ok = false;
+        values->append(convert(value.trimmed(), &ok));
+        if (!ok) {
+            fprintf(stderr, "Invalid value %s\n", qPrintable(value));
+            return false;
+        }
+    }
+    if (values->isEmpty()) {
+        fprintf(stderr, "Empty list %s\n", qPrintable(text));
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationDomain("iskrembilen.com");
+    app.setApplicationName("8bit-modem-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the bit error rate and speed of the modem through a simulated soundcard");
+    parser.addHelpOption();
+    QCommandLineOption baudOption("baud", "Baud rates to try, comma separated. Defaults to the ones in the editor that fit the sample rate.", "list");
+    parser.addOption(baudOption);
+    QCommandLineOption encodingOption("encoding", "Encodings to try, comma separated. Defaults to all of them.", "list", "bell103,bell202,4fsk,8fsk,16fsk");
+    parser.addOption(encodingOption);
+    QCommandLineOption waveformOption("waveform", "Waveforms to try, comma separated. Defaults to all of them.", "list", "square,sawtooth,triangle,sine");
+    parser.addOption(waveformOption);
+    QCommandLineOption volumeOption("volume", "Volumes to try, comma separated, from 0 to 1.", "list", "0.01,0.1,0.5,1");
+    parser.addOption(volumeOption);
+    QCommandLineOption bytesOption("bytes", "How many random bytes to send for each combination.", "count", "1000");
+    parser.addOption(bytesOption);
+    QCommandLineOption sampleRateOption("sample-rate", "Sample rate we send at.", "Hz", "44100");
+    parser.addOption(sampleRateOption);
+    QCommandLineOption inputRateOption("input-rate", "Sample rate the receiving side records at.", "Hz", "48000");
+    parser.addOption(inputRateOption);
+    QCommandLineOption skewOption("skew", "How far off the receiving clock is.", "ppm", "100");
+    parser.addOption(skewOption);
+    QCommandLineOption noiseOption("noise", "White noise level, relative to full scale.", "dBFS", "-50");
+    parser.addOption(noiseOption);
+    QCommandLineOption highPassOption("high-pass", "Cutoff of the DC blocking filter, 0 for none.", "Hz", "20");
+    parser.addOption(highPassOption);
+    QCommandLineOption noAgcOption("no-agc", "Don't simulate automatic gain control on the input.");
+    parser.addOption(noAgcOption);
+    QCommandLineOption jsonOption({"j", "json"}, "Write the results as JSON to this file, - for stdout.", "file");
+    parser.addOption(jsonOption);
+    parser.process(app);
+
+    AudioBuffer modulator;
+    modulator.sampleRate = parser.value(sampleRateOption).toInt();
+
+    ChannelSimulator channel;
+    channel.outputSampleRate = parser.value(inputRateOption).toInt();
+    channel.clockSkew = parser.value(skewOption).toDouble();
+    channel.noiseLevel = float(pow(10., parser.value(noiseOption).toDouble() / 20.));
+    channel.highPassFrequency = parser.value(highPassOption).toDouble();
+    channel.agcEnabled = !parser.isSet(noAgcOption);
+    if (modulator.sampleRate <= 0 || channel.outputSampleRate <= 0 || channel.highPassFrequency < 0.) {
+        fprintf(stderr, "Invalid sample rate or high-pass cutoff\n");
+        return 1;
+    }
+
+    QVector<int> bauds;
+    if (parser.isSet(baudOption)) {
+        if (!parseList(parser.value(baudOption), &bauds, [](const QString &value, bool *ok) { return value.toInt(ok); })) {
+            return 1;
+        }
+    } else {
+        // Same as in the editor, it doesn't make sense with less than four samples per bit
+        for (const int baud : { 110, 300, 1200, 9600, 19200, 57600, 115200 }) {
+            if (baud <= qMin(modulator.sampleRate, channel.outputSampleRate) / 4) {
+                bauds.append(baud);
+            }
+        }
+    }
+
+    // Ascending, so the last one without errors is the fastest
+    std::sort(bauds.begin(), bauds.end());
+
+    QVector<float> volumes;
+    if (!parseList(parser.value(volumeOption), &volumes, [](const QString &value, bool *ok) { return value.toFloat(ok); })) {
+        return 1;
+    }
+
+    QVector<AudioBuffer::Waveform> waveforms;
+    for (const QString &name : parser.value(waveformOption).split(',', Qt::SkipEmptyParts)) {
+        const int index = int(std::find(std::begin(s_waveformNames), std::end(s_waveformNames), name.trimmed()) - std::begin(s_waveformNames));
+        if (index >= AudioBuffer::WaveformCount) {
+            fprintf(stderr, "Invalid waveform %s\n", qPrintable(name));
+            return 1;
+        }
+        waveforms.append(AudioBuffer::Waveform(index));
+    }
+
+    QVector<AudioBuffer::Encoding> encodings;
+    for (const QString &name : parser.value(encodingOption).split(',', Qt::SkipEmptyParts)) {
+        const AudioBuffer::Encoding encoding = AudioBuffer::encodingFromName(name.trimmed());
+        if (encoding == AudioBuffer::EncodingCount) {
+            fprintf(stderr, "Invalid encoding %s\n", qPrintable(name));
+            return 1;
+        }
+        encodings.append(encoding);
+    }
+
+    const int byteCount = parser.value(bytesOption).toInt();
+    if (byteCount <= 0 || bauds.isEmpty() || waveforms.isEmpty() || encodings.isEmpty()) {
+        fprintf(stderr, "Nothing to do\n");
+        return 1;
+    }
+    std::mt19937 random(1);
+    QByteArray bytes(byteCount, '\0');
+    for (char &byte : bytes) {
+        byte = char(random());
+    }
+
+    const bool jsonToStdout = parser.value(jsonOption) == "-";
+
+    QJsonArray results;
+    for (const AudioBuffer::Encoding encoding : encodings) {
+        for (const AudioBuffer::Waveform waveform : waveforms) {
+            for (const float volume : volumes) {
+                int fastestClean = 0;
+                double fastestBytesPerSecond = 0.;
+                for (const int baud : bauds) {
+                    modulator.m_encoding = encoding;
+                    modulator.waveform = waveform;
+                    modulator.volume = volume;
+                    modulator.baud = baud;
+                    if (!modulator.tonesFitSampleRate()) {
+                        continue; // the MFSK tones go past half the sample rate
+                    }
+                    const Result result = runBenchmark(&modulator, &channel, bytes);
+
+                    // Without the silence at the end
+                    const double bytesPerSecond = byteCount * double(modulator.sampleRate) / modulator.framesForBytes(byteCount);
+                    if (result.bitErrors == 0) {
+                        fastestClean = baud;
+                        fastestBytesPerSecond = bytesPerSecond;
+                    }
+
+                    QJsonObject object;
+                    object["encoding"] = AudioBuffer::encodingName(encoding);
+                    object["waveform"] = s_waveformNames[waveform];
+                    object["volume"] = volume;
+                    object["baud"] = baud;
+                    object["bytes_per_second"] = bytesPerSecond;
+                    object["bits"] = double(result.bits);
+                    object["bit_errors"] = double(result.bitErrors);
+                    object["bit_error_rate"] = result.bitErrorRate();
+                    object["bytes_received"] = result.bytesReceived;
+                    object["framing_errors"] = double(result.framingErrors);
+                    object["modulate_ns_per_frame"] = double(result.timings.modulateNsecs) / qMax<int64_t>(result.timings.frames, 1);
+                    object["demodulate_ns_per_sample"] = double(result.timings.demodulateNsecs) / qMax<int64_t>(result.timings.samples, 1);
+                    results.append(object);
+
+                    if (!jsonToStdout) {
+                        printf("%-7s %-8s volume %5.3f %6d baud %7.1f bytes/s  BER %.2e  %d/%d bytes  %lld framing errors  modulate %6.2f ns/frame  demodulate %6.2f ns/sample\n",
+                                AudioBuffer::encodingName(encoding),
+                                s_waveformNames[waveform],
+                                volume,
+                                baud,
+                                bytesPerSecond,
+                                result.bitErrorRate(),
+                                result.bytesReceived,
+                                byteCount,
+                                (long long)result.framingErrors,
+                                object["modulate_ns_per_frame"].toDouble(),
+                                object["demodulate_ns_per_sample"].toDouble());
+                        fflush(stdout);
+                    }
+                }
+                if (!jsonToStdout) {
+                    if (fastestClean) {
+                        printf("%-7s %-8s volume %5.3f: fastest without errors is %d baud, %.1f bytes/s\n\n", AudioBuffer::encodingName(encoding), s_waveformNames[waveform], volume, fastestClean, fastestBytesPerSecond);
+                    } else {
+                        printf("%-7s %-8s volume %5.3f: nothing without errors\n\n", AudioBuffer::encodingName(encoding), s_waveformNames[waveform], volume);
+                    }
+                }
+            }
+        }
+    }
+
+    if (!parser.isSet(jsonOption)) {
+        return 0;
+    }
+
+    QJsonObject channelObject;
+    channelObject["sample_rate"] = modulator.sampleRate;
+    channelObject["input_rate"] = channel.outputSampleRate;
+    channelObject["skew_ppm"] = channel.clockSkew;
+    channelObject["noise_dbfs"] = parser.value(noiseOption).toDouble();
+    channelObject["high_pass_hz"] = channel.highPassFrequency;
+    channelObject["agc"] = channel.agcEnabled;
+
+    QJsonObject root;
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["channel"] = channelObject;
+    root["bytes"] = byteCount;
+    root["results"] = results;
+    const QByteArray json = QJsonDocument(root).toJson();
+
+    if (jsonToStdout) {
+        fwrite(json.constData(), 1, json.size(), stdout);
+        return 0;
+    }
+
+    QFile file(parser.value(jsonOption));
+    if (!file.open(QIODevice::WriteOnly)) {
+        fprintf(stderr, "Failed to open %s: %s\n", qPrintable(file.fileName()), qPrintable(file.errorString()));
+        return 1;
+    }
+    file.write(json);
+
+    return 0;
+}
@@ -0,0 +1,244 @@
+#include "AudioBuffer.h"
+#include "ChannelSimulator.h"
+#include "Demodulator.h"
+#include "Modem.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include <cstdio>
+#include <random>
+
+// Checks the audio side of uploading without the editor: decodes recordings
+// or what comes in on an input device, and finds out how fast we can go
+// before the demodulator stops keeping up.
+
+namespace {
+struct Settings
+{
+    AudioBuffer::Encoding encoding = AudioBuffer::Ascii8N1;
+    int baud = 300;
+    int sampleRate = 44100;
+    int spaceFrequency = 2025;
+    int markFrequency = 2225;
+};
+
+void setup(const Settings &settings, AudioBuffer *buffer)
+{
+    buffer->m_encoding = settings.encoding;
+    buffer->baud = settings.baud;
+    buffer->sampleRate = settings.sampleRate;
+    buffer->spaceFrequency = settings.spaceFrequency;
+    buffer->markFrequency = settings.markFrequency;
+    buffer->waveform = AudioBuffer::Sine;
+}
+
+int decode(const Settings &settings, const QString &path)
+{
+    QVector<float> samples;
+    int sampleRate = 0;
+    QString error;
+    if (!Demodulator::readWavFile(path, &samples, &sampleRate, &error)) {
+        fprintf(stderr, "Failed to read %s: %s\n", qPrintable(path), qPrintable(error));
+        return 1;
+    }
+
+    AudioBuffer buffer;
+    setup(settings, &buffer);
+
+    Demodulator demodulator;
+    demodulator.setup(buffer, sampleRate);
+    demodulator.process(samples.constData(), size_t(samples.count()));
+
+    const QByteArray bytes = demodulator.takeBytes();
+    if (!bytes.isEmpty()) {
+        printf("%s\n", bytes.toHex(' ').constData());
+    }
+    fprintf(stderr, "%d bytes, %lld framing errors\n", bytes.count(), (long long)demodulator.framingErrors());
+    return 0;
+}
+
+int encode(const Settings &settings, const QByteArray &hex, const QString &path)
+{
+    AudioBuffer buffer;
+    setup(settings, &buffer);
+    if (!buffer.tonesFitSampleRate()) {
+        fprintf(stderr, "The highest tone, %d Hz, is too high for a sample rate of %d Hz\n", buffer.highestFrequency(), buffer.sampleRate);
+        return 1;
+    }
+    if (!buffer.saveWavFile(path, QByteArray::fromHex(hex))) {
+        fprintf(stderr, "Failed to write %s\n", qPrintable(path));
+        return 1;
+    }
+    return 0;
+}
+
+// Modulates random bytes, adds white noise and demodulates them again,
+// returns how many came back wrong (or not at all). See 8bit-modem-benchmark
+// for the rest of what a soundcard does to it.
+int loopback(const Settings &settings, const QByteArray &bytes, const double snr, const uint32_t seed, int64_t *framingErrors)
+{
+    AudioBuffer modulator;
+    setup(settings, &modulator);
+    modulator.prepare();
+
+    Demodulator demodulator;
+    demodulator.setup(modulator, modulator.sampleRate);
+
+    // Relative to a sine at the current volume
+    ChannelSimulator channel;
+    channel.inputSampleRate = modulator.sampleRate;
+    channel.outputSampleRate = modulator.sampleRate;
+    channel.highPassFrequency = 0.;
+    channel.noiseLevel = float(modulator.volume / sqrt(2.) / pow(10., snr / 20.));
+    channel.seed = seed;
+    channel.reset();
+
+    const QByteArray received = channel.loopback(&modulator, &demodulator, bytes);
+
+    int errors = qAbs(received.count() - bytes.count());
+    for (int i=0; i<qMin(received.count(), bytes.count()); i++) {
+        errors += received[i] != bytes[i];
+    }
+    *framingErrors = demodulator.framingErrors();
+    return errors;
+}
+
+int loopbackSweep(const Settings &settings, const int byteCount, const double snr)
+{
+    std::mt19937 random(1);
+    QByteArray bytes(byteCount, '\0');
+    for (char &byte : bytes) {
+        byte = char(random());
+    }
+
+    AudioBuffer limits;
+    setup(settings, &limits);
+
+    int best = 0;
+    for (const int baud : { 110, 150, 300, 600, 1200, 2400, 4800, 9600 }) {
+        if (baud > limits.maxBaud()) {
+            break;
+        }
+        Settings current = settings;
+        current.baud = baud;
+
+        int64_t framingErrors = 0;
+        const int errors = loopback(current, bytes, snr, random(), &framingErrors);
+        printf("%5d baud: %d of %d bytes wrong, %lld framing errors\n", baud, errors, byteCount, (long long)framingErrors);
+        if (errors == 0) {
+            best = baud;
+        }
+    }
+    if (best) {
+        Settings fastest = settings;
+        fastest.baud = best;
+        AudioBuffer buffer;
+        setup(fastest, &buffer);
+        printf("Highest reliable baud at %.1f dB SNR: %d, %.1f bytes per second\n", snr, best, byteCount * double(buffer.sampleRate) / buffer.framesForBytes(byteCount));
+    } else {
+        printf("Nothing got through at %.1f dB SNR\n", snr);
+    }
+    return best ? 0 : 1;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationDomain("iskrembilen.com");
+    app.setApplicationName("8bit-modem");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Encodes, decodes and tests the audio used for uploading");
+    parser.addHelpOption();
+    QCommandLineOption decodeOption("decode", "Decode a recording and print the bytes in hex.", "file.wav");
+    parser.addOption(decodeOption);
+    QCommandLineOption encodeOption("encode", "Write the audio for the bytes (in hex) to the file given with --output.", "hex");
+    parser.addOption(encodeOption);
+    QCommandLineOption outputOption({"o", "output"}, "Where --encode writes to.", "file.wav");
+    parser.addOption(outputOption);
+    QCommandLineOption listenOption("listen", "Decode what comes in on an input device and print the bytes in hex as they arrive.");
+    parser.addOption(listenOption);
+    QCommandLineOption deviceOption("device", "Input device for --listen, defaults to the default one.", "name");
+    parser.addOption(deviceOption);
+    QCommandLineOption devicesOption("devices", "List the input devices.");
+    parser.addOption(devicesOption);
+    QCommandLineOption loopbackOption("loopback", "Send random bytes through the modulator, noise and demodulator at increasing baud rates, to find the fastest that still works.");
+    parser.addOption(loopbackOption);
+    QCommandLineOption snrOption("snr", "Signal to noise ratio in dB for --loopback.", "dB", "20");
+    parser.addOption(snrOption);
+    QCommandLineOption bytesOption("bytes", "How many bytes to send at each baud with --loopback.", "count", "1000");
+    parser.addOption(bytesOption);
+    QCommandLineOption encodingOption("encoding", "bell103 (with the frequencies from --space and --mark), bell202, 4fsk, 8fsk or 16fsk.", "name", "bell103");
+    parser.addOption(encodingOption);
+    QCommandLineOption baudOption("baud", "Baud rate.", "baud", "300");
+    parser.addOption(baudOption);
+    QCommandLineOption sampleRateOption("sample-rate", "Sample rate for --encode and --loopback.", "Hz", "44100");
+    parser.addOption(sampleRateOption);
+    QCommandLineOption spaceOption("space", "Space frequency, same as in the modem settings.", "Hz", "2025");
+    parser.addOption(spaceOption);
+    QCommandLineOption markOption("mark", "Mark frequency, same as in the modem settings.", "Hz", "2225");
+    parser.addOption(markOption);
+    parser.process(app);
+
+    Settings settings;
+    settings.encoding = AudioBuffer::encodingFromName(parser.value(encodingOption));
+    if (settings.encoding == AudioBuffer::EncodingCount) {
+        fprintf(stderr, "Invalid encoding %s\n", qPrintable(parser.value(encodingOption)));
+        return 1;
+    }
+    settings.baud = parser.value(baudOption).toInt();
+    settings.sampleRate = parser.value(sampleRateOption).toInt();
+    settings.spaceFrequency = parser.value(spaceOption).toInt();
+    settings.markFrequency = parser.value(markOption).toInt();
+    if (settings.baud <= 0 || settings.sampleRate <= 0 || settings.spaceFrequency <= 0 || settings.markFrequency <= 0) {
+        fprintf(stderr, "Invalid baud, sample rate or frequencies\n");
+        return 1;
+    }
+
+    if (parser.isSet(decodeOption)) {
+        return decode(settings, parser.value(decodeOption));
+    }
+
+    if (parser.isSet(encodeOption)) {
+        if (!parser.isSet(outputOption)) {
+            fprintf(stderr, "--encode needs --output\n");
+            return 1;
+        }
+        return encode(settings, parser.value(encodeOption).toLatin1(), parser.value(outputOption));
+    }
+
+    if (parser.isSet(loopbackOption)) {
+        return loopbackSweep(settings, qMax(1, parser.value(bytesOption).toInt()), parser.value(snrOption).toDouble());
+    }
+
+    if (parser.isSet(devicesOption) || parser.isSet(listenOption)) {
+        Modem modem(nullptr);
+        if (!modem.audioAvailable()) {
+            fprintf(stderr, "Audio not available\n");
+            return 1;
+        }
+        if (parser.isSet(devicesOption)) {
+            for (const QString &name : modem.audioInputDevices()) {
+                printf("%s\n", qPrintable(name));
+            }
+            return 0;
+        }
+
+        modem.setEncoding(settings.encoding);
+        modem.setBaud(settings.baud);
+        modem.setFrequencies(settings.spaceFrequency, settings.markFrequency);
+        QObject::connect(&modem, &Modem::received, [](const QByteArray &bytes) {
+            printf("%s\n", bytes.toHex(' ').constData());
+            fflush(stdout);
+        });
+        if (!modem.startListening(parser.value(deviceOption))) {
+            fprintf(stderr, "Failed to start listening\n");
+            return 1;
+        }
+        return app.exec();
+    }
+
+    parser.showHelp(1);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Fixed size lock free queue for exactly one producer thread and one consumer
+// thread, e.g. the GUI and the audio callback. Never allocates or blocks
+// after it's created, so it's safe to use from a real-time thread.
+//
+// The read and write positions only ever count up and are masked when
+// indexing, so full and empty are never ambiguous.
+template<typename T>
+class RingBuffer
+{
+public:
+    // Rounded up to a power of two
+    explicit RingBuffer(const size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size *= 2;
+        }
+        m_data.reset(new T[size]);
+        m_mask = size - 1;
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer &operator=(const RingBuffer&) = delete;
+
+    size_t capacity() const { return m_mask + 1; }
+
+    // Producer only, returns how many fit
+    size_t push(const T *values, const size_t count) {
+        const size_t write = m_write.load(std::memory_order_relaxed);
+        const size_t read = m_read.load(std::memory_order_acquire);
+        const size_t pushed = std::min(count, capacity() - (write - read));
+        for (size_t i=0; i<pushed; i++) {
+            m_data[(write + i) & m_mask] = values[i];
+        }
+        m_write.store(write + pushed, std::memory_order_release);
+        return pushed;
+    }
+
+    // Consumer only, returns how many there were
+    size_t pop(T *values, const size_t count) {
+        const size_t read = m_read.load(std::memory_order_relaxed);
+        const size_t write = m_write.load(std::memory_order_acquire);
+        const size_t popped = std::min(count, write - read);
+        for (size_t i=0; i<popped; i++) {
+            values[i] = m_data[(read + i) & m_mask];
+        }
+        m_read.store(read + popped, std::memory_order_release);
+        return popped;
+    }
+
+    // Consumer only, returns false if it's empty
+    bool pop(T *value) {
+        const size_t read = m_read.load(std::memory_order_relaxed);
+        if (read == m_write.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *value = m_data[read & m_mask];
+        m_read.store(read + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Either side, but it's only a snapshot if the other side is busy
+    size_t size() const {
+        return m_write.load(std::memory_order_acquire) - m_read.load(std::memory_order_acquire);
+    }
+    bool isEmpty() const { return size() == 0; }
+
+    // Only when neither side is using it
+    void clear() {
+        m_read.store(m_write.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+private:
+    std::unique_ptr<T[]> m_data;
+    size_t m_mask = 0;
+
+    // Separate cache lines, so the two sides don't keep stealing them from each other
+    alignas(64) std::atomic<size_t> m_read{0};
+    alignas(64) std::atomic<size_t> m_write{0};
+};
@@ -0,0 +1,249 @@
+#include "SimdEmulator.h"
+
+#include <cstring>
+
+namespace {
+
+#if defined(__GNUC__)
+// Lets the compiler pick the instructions, so it works with SSE2, AVX2, NEON
+// or whatever the target has.
+#if defined(__AVX2__)
+constexpr int s_laneCount = 32;
+#else
+constexpr int s_laneCount = 16;
+#endif
+typedef uint8_t Lanes __attribute__((vector_size(s_laneCount)));
+
+inline Lanes equal(const Lanes a, const Lanes b) { return (Lanes)(a == b); }
+inline Lanes lessThan(const Lanes a, const Lanes b) { return (Lanes)(a < b); }
+inline Lanes splat(const uint8_t value) { return Lanes{} + value; }
+
+#else
+// Plain loops, the compiler can usually vectorize these too
+constexpr int s_laneCount = 16;
+struct Lanes
+{
+    uint8_t v[s_laneCount];
+
+    uint8_t &operator[](const int i) { return v[i]; }
+    uint8_t operator[](const int i) const { return v[i]; }
+};
+
+#define LANES_OPERATOR(op) \
+    inline Lanes operator op(const Lanes a, const Lanes b) { \
+        Lanes ret; \
+        for (int i=0; i<s_laneCount; i++) { ret.v[i] = uint8_t(a.v[i] op b.v[i]); } \
+        return ret; \
+    }
+LANES_OPERATOR(+)
+LANES_OPERATOR(&)
+LANES_OPERATOR(|)
+LANES_OPERATOR(^)
+#undef LANES_OPERATOR
+
+inline Lanes operator~(const Lanes a)
+{
+    Lanes ret;
+    for (int i=0; i<s_laneCount; i++) { ret.v[i] = uint8_t(~a.v[i]); }
+    return ret;
+}
+
+inline Lanes operator>>(const Lanes a, const int shift)
+{
+    Lanes ret;
+    for (int i=0; i<s_laneCount; i++) { ret.v[i] = uint8_t(a.v[i] >> shift); }
+    return ret;
+}
+
+inline Lanes equal(const Lanes a, const Lanes b)
+{
+    Lanes ret;
+    for (int i=0; i<s_laneCount; i++) { ret.v[i] = a.v[i] == b.v[i] ? 0xFF : 0; }
+    return ret;
+}
+
+inline Lanes lessThan(const Lanes a, const Lanes b)
+{
+    Lanes ret;
+    for (int i=0; i<s_laneCount; i++) { ret.v[i] = a.v[i] < b.v[i] ? 0xFF : 0; }
+    return ret;
+}
+
+inline Lanes splat(const uint8_t value)
+{
+    Lanes ret;
+    memset(ret.v, value, sizeof ret.v);
+    return ret;
+}
+#endif
+
+// Masks are all ones or all zeros in each lane
+inline Lanes select(const Lanes mask, const Lanes ifSet, const Lanes otherwise)
+{
+    return (ifSet & mask) | (otherwise & ~mask);
+}
+
+inline bool isZero(const Lanes lanes)
+{
+    uint64_t words[s_laneCount / 8];
+    memcpy(words, &lanes, sizeof words);
+    uint64_t combined = 0;
+    for (const uint64_t word : words) {
+        combined |= word;
+    }
+    return combined == 0;
+}
+
+} // namespace
+
+SimdEmulator::SimdEmulator(const Emulator &emulator)
+{
+    for (int opcode=0; opcode<16; opcode++) {
+        m_operations[opcode] = emulator.operation(opcode);
+    }
+    m_cyclesPerInstruction = emulator.cyclesPerInstruction();
+}
+
+bool SimdEmulator::isSupported(const Emulator &emulator)
+{
+    if (emulator.instructionSize() != 1) {
+        return false;
+    }
+    for (int opcode=0; opcode<16; opcode++) {
+        switch(emulator.operation(opcode)) {
+        case Emulator::Operation::Psh:
+        case Emulator::Operation::Pop:
+        case Emulator::Operation::Jsr:
+        case Emulator::Operation::Rts:
+            return false;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+int SimdEmulator::laneCount()
+{
+    return s_laneCount;
+}
+
+void SimdEmulator::run(const QByteArray *memories, BatchEmulator::Result *results, const int count, const uint64_t maxInstructions) const
+{
+    Q_ASSERT(count <= s_laneCount);
+
+    // memory[address] holds that address for all the machines
+    Lanes memory[16];
+    Lanes running = splat(0);
+    for (int address=0; address<16; address++) {
+        memory[address] = splat(0);
+    }
+    for (int lane=0; lane<count; lane++) {
+        const QByteArray &initial = memories[lane];
+        for (int address=0; address<16 && address<initial.size(); address++) {
+            memory[address][lane] = uint8_t(initial[address]);
+        }
+        running[lane] = 0xFF;
+    }
+
+    Lanes a = splat(0);
+    Lanes b = splat(0);
+    Lanes pc = splat(0);
+    Lanes carry = splat(0);
+    Lanes zero = splat(0);
+
+    auto stop = [&](const Lanes stopped, const Emulator::StopReason reason, const uint64_t instructions) {
+        for (int lane=0; lane<count; lane++) {
+            if (!stopped[lane]) {
+                continue;
+            }
+            results[lane].reason = reason;
+            results[lane].instructions = instructions;
+        }
+        running = running & ~stopped;
+    };
+
+    uint64_t step = 0;
+    for (; step<maxInstructions && !isZero(running); step++) {
+        // Fetch, memory[pc] for each lane
+        Lanes instruction = splat(0);
+        for (int address=0; address<16; address++) {
+            instruction = instruction | (memory[address] & equal(pc, splat(address)));
+        }
+        const Lanes opcode = instruction >> 4;
+        const Lanes operand = instruction & splat(0xF);
+
+        Lanes operation = splat(0);
+        for (int op=0; op<16; op++) {
+            operation = operation | (equal(opcode, splat(op)) & splat(uint8_t(m_operations[op])));
+        }
+
+        const Lanes invalid = equal(operation, splat(uint8_t(Emulator::Operation::Invalid))) & running;
+        if (!isZero(invalid)) {
+            stop(invalid, Emulator::InvalidOpcode, step);
+        }
+        const Lanes active = running;
+
+        auto is = [&](const Emulator::Operation op) {
+            return equal(operation, splat(uint8_t(op))) & active;
+        };
+
+        // memory[operand] for each lane
+        Lanes value = splat(0);
+        for (int address=0; address<16; address++) {
+            value = value | (memory[address] & equal(operand, splat(address)));
+        }
+
+        // Both add and subtract in one go, subtraction is adding the two's complement
+        const Lanes fromMemory = is(Emulator::Operation::Add) | is(Emulator::Operation::Sub);
+        const Lanes subtract = is(Emulator::Operation::Sub) | is(Emulator::Operation::Subi);
+        const Lanes calculate = fromMemory | is(Emulator::Operation::Addi) | subtract;
+        const Lanes argument = select(fromMemory, value, operand);
+        const Lanes sum = a + (argument ^ subtract) + (subtract & splat(1));
+        const Lanes carryOut = select(subtract, ~lessThan(a, argument), lessThan(sum, a));
+
+        const Lanes jump = is(Emulator::Operation::Jmp) |
+                (is(Emulator::Operation::Jc) & carry) |
+                (is(Emulator::Operation::Jz) & zero);
+
+        const Lanes store = is(Emulator::Operation::Sta);
+        if (!isZero(store)) {
+            for (int address=0; address<16; address++) {
+                memory[address] = select(store & equal(operand, splat(address)), a, memory[address]);
+            }
+        }
+
+        b = select(calculate, argument, b);
+        carry = select(calculate, carryOut, carry);
+        zero = select(calculate, equal(sum, splat(0)), zero);
+        a = select(calculate, sum, a);
+        a = select(is(Emulator::Operation::Lda), value, a);
+        a = select(is(Emulator::Operation::Ldi), operand, a);
+
+        pc = select(active, select(jump, operand, (pc + splat(1)) & splat(0xF)), pc);
+
+        const Lanes out = is(Emulator::Operation::Out);
+        if (!isZero(out)) {
+            for (int lane=0; lane<count; lane++) {
+                if (out[lane]) {
+                    results[lane].outputs.append({(step + 1) * m_cyclesPerInstruction, a[lane]});
+                }
+            }
+        }
+
+        const Lanes halt = is(Emulator::Operation::Hlt);
+        if (!isZero(halt)) {
+            stop(halt, Emulator::Halted, step + 1);
+        }
+    }
+
+    for (int lane=0; lane<count; lane++) {
+        if (running[lane]) {
+            results[lane].reason = Emulator::InstructionLimit;
+            results[lane].instructions = step;
+        }
+        results[lane].cycles = results[lane].instructions * m_cyclesPerInstruction;
+        results[lane].a = a[lane];
+        results[lane].pc = pc[lane];
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "BatchEmulator.h"
+
+// Steps a whole SIMD register worth of machines with 8 bit instructions
+// (4 bit addresses) at the same time, one machine per byte lane.
+//
+// All 16 bytes of memory for all the machines are kept in registers, and
+// every step all operations are computed for all lanes and masked by which
+// one each lane actually has, so machines taking different branches don't
+// need to be split up.
+//
+// Doesn't support the stack instructions, there's no room for them.
+class SimdEmulator
+{
+public:
+    // Uses the same decoding as the emulator
+    explicit SimdEmulator(const Emulator &emulator);
+
+    static bool isSupported(const Emulator &emulator);
+
+    // How many machines run in each group
+    static int laneCount();
+
+    // Runs count (up to laneCount()) machines, same as BatchEmulator::run()
+    void run(const QByteArray *memories, BatchEmulator::Result *results, const int count, const uint64_t maxInstructions) const;
+
+private:
+    Emulator::Operation m_operations[16];
+    uint8_t m_cyclesPerInstruction = 5;
+};
@@ -0,0 +1,100 @@
+#include "Tokenizer.h"
+
+#include <limits>
+
+static inline bool isSpace(const QChar c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool Tokenizer::next(Token *token)
+{
+    while (m_position < m_line.length() && isSpace(m_line[m_position])) {
+        m_position++;
+    }
+    if (m_position >= m_line.length()) {
+        return false;
+    }
+
+    token->start = m_position;
+
+    if (m_line[m_position] == ';') {
+        token->type = Token::Comment;
+        token->text = m_line.mid(m_position);
+        m_position = m_line.length();
+        return true;
+    }
+
+    int end = m_position;
+    while (end < m_line.length() && !isSpace(m_line[end]) && m_line[end] != ';') {
+        end++;
+    }
+    token->text = m_line.mid(m_position, end - m_position);
+    m_position = end;
+
+    if (m_wordCount++ == 0) {
+        if (token->text.endsWith(QLatin1Char(':'))) {
+            token->type = Token::Label;
+            token->text.chop(1);
+        } else if (token->text.startsWith(QLatin1Char('.'))) {
+            token->type = Token::Directive;
+        } else {
+            token->type = Token::Mnemonic;
+        }
+        return true;
+    }
+
+    int number;
+    if (parseNumber(token->text, &number)) {
+        token->type = Token::Number;
+    } else {
+        token->type = Token::Identifier;
+    }
+    return true;
+}
+
+bool Tokenizer::parseNumber(const QStringView text, int *value)
+{
+    int position = 0;
+    int base = 10;
+    bool negative = false;
+
+    if (text.startsWith(QLatin1String("0x"))) {
+        base = 16;
+        position = 2;
+    } else if (text.startsWith(QLatin1Char('-')) || text.startsWith(QLatin1Char('+'))) {
+        negative = text[0] == '-';
+        position = 1;
+    }
+    if (position >= text.length()) {
+        return false;
+    }
+
+    qint64 result = 0;
+    for (; position < text.length(); position++) {
+        const ushort c = text[position].unicode();
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (base == 16 && c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (base == 16 && c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        result = result * base + digit;
+        if (result > qint64(std::numeric_limits<int>::max()) + 1) {
+            return false;
+        }
+    }
+    if (negative) {
+        result = -result;
+    }
+    if (result > std::numeric_limits<int>::max()) {
+        return false;
+    }
+
+    *value = int(result);
+    return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QStringView>
+
+// Splits a line of assembly into tokens, without copying or allocating
+// anything, so it is cheap enough to run for every keystroke.
+//
+// Shared between the assembler, the syntax highlighter and the line number
+// gutter so they all agree on what a line contains.
+struct Token
+{
+    enum Type {
+        Mnemonic, // first word on the line
+        Directive, // first word on the line, starting with '.'
+        Label, // first word on the line, ending with ':' (which is not included in text)
+        Number,
+        Identifier, // anything else after the first word, usually a label reference
+        Comment // from ';' to the end of the line
+    };
+    Type type = Mnemonic;
+
+    int start = 0; // position in the line
+    QStringView text;
+};
+
+class Tokenizer
+{
+public:
+    explicit Tokenizer(const QStringView line) : m_line(line) {}
+
+    // Returns false when there are no more tokens
+    bool next(Token *token);
+
+    // Decimal or 0x-prefixed hex, like we always have accepted
+    static bool parseNumber(const QStringView text, int *value);
+
+private:
+    QStringView m_line;
+    int m_position = 0;
+    int m_wordCount = 0;
+};
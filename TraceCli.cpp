@@ -0,0 +1,156 @@
+#include "TraceReader.h"
+#include "Tokenizer.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+
+#include <cstdio>
+
+// Looks at traces written by 8bit-asm --trace, mostly to compare what the
+// hardware sent back against what the program should have done.
+
+namespace {
+void printSteps(const TraceReader &trace, const uint64_t from, const uint64_t count)
+{
+    QVector<TraceReader::Step> steps;
+    for (int i=0; i<trace.blockCount(); i++) {
+        const TraceReader::Block &block = trace.block(i);
+        if (block.firstInstruction + block.stepCount <= from) {
+            continue;
+        }
+        if (block.firstInstruction >= from + count) {
+            break;
+        }
+        if (!trace.readSteps(i, &steps)) {
+            fprintf(stderr, "Block %d is corrupt\n", i);
+        }
+        for (const TraceReader::Step &step : steps) {
+            if (step.instruction < from || step.instruction >= from + count) {
+                continue;
+            }
+            QString line = QString::asprintf("%10llu  pc %3d  op 0x%02x  a %3d  b %3d  sp %3d  %c%c",
+                    (unsigned long long)step.instruction, step.pc, step.opcode, step.a, step.b, step.sp,
+                    step.carry ? 'C' : '-', step.zero ? 'Z' : '-');
+            if (step.writtenAddress >= 0) {
+                line += QString::asprintf("  [%d] = %d", step.writtenAddress, step.writtenValue);
+            }
+            if (step.pushed) {
+                line += QString::asprintf("  stack[%d] = %d", step.sp, step.pushedValue);
+            }
+            if (step.output) {
+                line += QString::asprintf("  out %d", step.a);
+            }
+            if (step.halted) {
+                line += "  halt";
+            }
+            printf("%s\n", qPrintable(line));
+        }
+    }
+}
+
+// Expected values are just numbers separated by whitespace, like what the
+// serial monitor prints
+bool readExpected(const QString &path, QVector<int> *values)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "Failed to open %s: %s\n", qPrintable(path), qPrintable(file.errorString()));
+        return false;
+    }
+    const QStringList words = QString::fromUtf8(file.readAll()).simplified().split(' ', Qt::SkipEmptyParts);
+    for (const QString &word : words) {
+        int value = 0;
+        if (!Tokenizer::parseNumber(word, &value) || value < 0 || value > 0xFF) {
+            fprintf(stderr, "%s: invalid value '%s'\n", qPrintable(path), qPrintable(word));
+            return false;
+        }
+        values->append(value);
+    }
+    return true;
+}
+
+int compare(const TraceReader &trace, const QVector<int> &expected)
+{
+    const QVector<Emulator::Output> outputs = trace.outputs();
+    int mismatches = 0;
+    for (int i=0; i<qMin(outputs.count(), expected.count()); i++) {
+        if (outputs[i].value == expected[i]) {
+            continue;
+        }
+        if (mismatches++ < 10) {
+            const uint64_t instruction = outputs[i].cycle / trace.cyclesPerInstruction() - 1;
+            printf("output %d: expected %d, trace has %d (instruction %llu, cycle %llu)\n", i, expected[i], outputs[i].value,
+                    (unsigned long long)instruction, (unsigned long long)outputs[i].cycle);
+        }
+    }
+    if (outputs.count() != expected.count()) {
+        printf("expected %d outputs, trace has %d\n", expected.count(), outputs.count());
+        mismatches++;
+    }
+    if (mismatches == 0) {
+        printf("all %d outputs match\n", outputs.count());
+    }
+    return mismatches ? 1 : 0;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationDomain("iskrembilen.com");
+    app.setApplicationName("8bit-trace");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Shows traces recorded with 8bit-asm --trace");
+    parser.addHelpOption();
+    QCommandLineOption stepsOption("steps", "Print every step.");
+    parser.addOption(stepsOption);
+    QCommandLineOption fromOption("from", "First step to print with --steps.", "instruction", "0");
+    parser.addOption(fromOption);
+    QCommandLineOption countOption("count", "How many steps to print with --steps, defaults to all.", "count");
+    parser.addOption(countOption);
+    QCommandLineOption outputsOption("outputs", "Print the values written by out, one per line.");
+    parser.addOption(outputsOption);
+    QCommandLineOption compareOption("compare", "Compare what was written by out with the values in a file.", "file");
+    parser.addOption(compareOption);
+    parser.addPositionalArgument("trace", "Trace file to read.");
+    parser.process(app);
+
+    if (parser.positionalArguments().count() != 1) {
+        parser.showHelp(1);
+    }
+    const QString path = parser.positionalArguments().first();
+
+    TraceReader trace;
+    if (!trace.open(path)) {
+        fprintf(stderr, "Failed to open %s: %s\n", qPrintable(path), qPrintable(trace.errorString()));
+        return 1;
+    }
+
+    if (parser.isSet(stepsOption)) {
+        const uint64_t from = parser.value(fromOption).toULongLong();
+        const uint64_t count = parser.isSet(countOption) ? parser.value(countOption).toULongLong() : UINT64_MAX - from;
+        printSteps(trace, from, count);
+        return 0;
+    }
+
+    if (parser.isSet(outputsOption)) {
+        for (const Emulator::Output &output : trace.outputs()) {
+            printf("%d\n", output.value);
+        }
+        return 0;
+    }
+
+    if (parser.isSet(compareOption)) {
+        QVector<int> expected;
+        if (!readExpected(parser.value(compareOption), &expected)) {
+            return 1;
+        }
+        return compare(trace, expected);
+    }
+
+    printf("%llu steps in %d blocks, %d bit instructions, %d bytes of memory, %d outputs\n",
+            (unsigned long long)trace.stepCount(), trace.blockCount(), trace.instructionSize() * 8, trace.memorySize(), trace.outputs().count());
+    return 0;
+}
@@ -0,0 +1,249 @@
+#include "TraceReader.h"
+
+#include "TraceRecorder.h"
+
+#include <cstring>
+
+namespace {
+uint64_t readValue(const uint8_t *data, const int bytes)
+{
+    uint64_t value = 0;
+    for (int i=0; i<bytes; i++) {
+        value |= uint64_t(data[i]) << (i * 8);
+    }
+    return value;
+}
+} // namespace
+
+TraceReader::~TraceReader()
+{
+    close();
+}
+
+bool TraceReader::open(const QString &path)
+{
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+    m_size = m_file.size();
+    if (m_size < quint64(TraceRecorder::FileHeaderSize)) {
+        m_errorString = "File is too small";
+        close();
+        return false;
+    }
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        m_errorString = m_file.errorString();
+        close();
+        return false;
+    }
+
+    if (memcmp(m_data, TraceRecorder::FileMagic, sizeof TraceRecorder::FileMagic) != 0) {
+        m_errorString = "Not a trace file";
+        close();
+        return false;
+    }
+    if (readValue(m_data + 8, 2) != TraceRecorder::Version) {
+        m_errorString = "Unsupported trace version " + QString::number(readValue(m_data + 8, 2));
+        close();
+        return false;
+    }
+    m_instructionSize = m_data[10];
+    m_cyclesPerInstruction = m_data[11];
+    m_memorySize = int(readValue(m_data + 12, 2));
+    if ((m_instructionSize != 1 && m_instructionSize != 2) || m_memorySize <= 0 || m_memorySize > 256) {
+        m_errorString = "Invalid trace header";
+        close();
+        return false;
+    }
+
+    if (!readIndex() && !scanBlocks()) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void TraceReader::close()
+{
+    if (m_data) {
+        m_file.unmap(const_cast<uint8_t*>(m_data));
+        m_data = nullptr;
+    }
+    m_file.close();
+    m_size = 0;
+    m_blocks.clear();
+}
+
+bool TraceReader::parseBlock(const quint64 offset, Block *block) const
+{
+    const quint64 headerSize = TraceRecorder::BlockHeaderSize + m_memorySize + TraceRecorder::StackSize;
+    if (offset > m_size || headerSize > m_size - offset) {
+        return false;
+    }
+    const uint8_t *data = m_data + offset;
+    if (memcmp(data, TraceRecorder::BlockMagic, sizeof TraceRecorder::BlockMagic) != 0) {
+        return false;
+    }
+    const quint64 size = readValue(data + 4, 4);
+    if (size < headerSize || size > m_size - offset) {
+        return false;
+    }
+
+    block->stepCount = int(readValue(data + 8, 4));
+    block->firstInstruction = readValue(data + 12, 8);
+    block->pc = data[20];
+    block->a = data[21];
+    block->b = data[22];
+    block->sp = data[23];
+    block->carry = data[24] & TraceRecorder::Carry;
+    block->zero = data[24] & TraceRecorder::Zero;
+    block->halted = data[25] & TraceRecorder::Halted;
+    block->memory = data + TraceRecorder::BlockHeaderSize;
+    block->stack = block->memory + m_memorySize;
+    block->records = block->stack + TraceRecorder::StackSize;
+    block->recordsSize = int(size - headerSize);
+    return true;
+}
+
+bool TraceReader::readIndex()
+{
+    const quint64 trailerSize = 8 + sizeof TraceRecorder::IndexMagic;
+    if (m_size < TraceRecorder::FileHeaderSize + trailerSize) {
+        return false;
+    }
+    const uint8_t *trailer = m_data + m_size - trailerSize;
+    if (memcmp(trailer + 8, TraceRecorder::IndexMagic, sizeof TraceRecorder::IndexMagic) != 0) {
+        return false;
+    }
+    const quint64 count = readValue(trailer, 8);
+    if (count > (m_size - TraceRecorder::FileHeaderSize - trailerSize) / 8) {
+        return false;
+    }
+
+    const uint8_t *offsets = trailer - count * 8;
+    QVector<Block> blocks(static_cast<int>(count));
+    for (int i=0; i<blocks.count(); i++) {
+        if (!parseBlock(readValue(offsets + i * 8, 8), &blocks[i])) {
+            return false;
+        }
+    }
+    m_blocks = blocks;
+    return true;
+}
+
+bool TraceReader::scanBlocks()
+{
+    quint64 offset = TraceRecorder::FileHeaderSize;
+    Block block;
+    while (parseBlock(offset, &block)) {
+        m_blocks.append(block);
+        offset += TraceRecorder::BlockHeaderSize + m_memorySize + TraceRecorder::StackSize + block.recordsSize;
+    }
+    if (m_blocks.isEmpty()) {
+        m_errorString = "No blocks in trace";
+        return false;
+    }
+    return true;
+}
+
+uint64_t TraceReader::stepCount() const
+{
+    uint64_t count = 0;
+    for (const Block &block : m_blocks) {
+        count += block.stepCount;
+    }
+    return count;
+}
+
+bool TraceReader::readSteps(const int blockIndex, QVector<Step> *steps) const
+{
+    const Block &block = m_blocks[blockIndex];
+    const uint8_t addressMask = m_memorySize - 1;
+
+    steps->clear();
+    steps->reserve(block.stepCount);
+
+    Step step;
+    step.instruction = block.firstInstruction;
+    step.nextPc = block.pc;
+    step.a = block.a;
+    step.b = block.b;
+    step.sp = block.sp;
+
+    const uint8_t *data = block.records;
+    const uint8_t *end = data + block.recordsSize;
+    for (int i=0; i<block.stepCount; i++) {
+        if (end - data < 2) {
+            return false;
+        }
+        const uint8_t flags = *data++;
+        uint8_t moreFlags = 0;
+        if (flags & TraceRecorder::More) {
+            moreFlags = *data++;
+            if (data == end) {
+                return false;
+            }
+        }
+        if (i > 0) {
+            step.instruction++;
+        }
+        step.pc = step.nextPc;
+        step.opcode = *data++;
+
+        const int extra = bool(flags & TraceRecorder::Jumped) + bool(flags & TraceRecorder::AChanged) +
+                bool(flags & TraceRecorder::BChanged) + 2 * bool(flags & TraceRecorder::Written) +
+                bool(moreFlags & TraceRecorder::SpChanged) + bool(moreFlags & TraceRecorder::Pushed);
+        if (end - data < extra) {
+            return false;
+        }
+
+        step.nextPc = (flags & TraceRecorder::Jumped) ? *data++ : (step.pc + m_instructionSize) & addressMask;
+        if (flags & TraceRecorder::AChanged) {
+            step.a = *data++;
+        }
+        if (flags & TraceRecorder::BChanged) {
+            step.b = *data++;
+        }
+        step.writtenAddress = -1;
+        if (flags & TraceRecorder::Written) {
+            step.writtenAddress = *data++;
+            step.writtenValue = *data++;
+        }
+        if (moreFlags & TraceRecorder::SpChanged) {
+            step.sp = *data++;
+        }
+        step.pushed = moreFlags & TraceRecorder::Pushed;
+        if (step.pushed) {
+            step.pushedValue = *data++;
+        }
+        step.carry = flags & TraceRecorder::Carry;
+        step.zero = flags & TraceRecorder::Zero;
+        step.output = flags & TraceRecorder::Output;
+        step.halted = moreFlags & TraceRecorder::Halted;
+
+        steps->append(step);
+    }
+
+    return true;
+}
+
+QVector<Emulator::Output> TraceReader::outputs() const
+{
+    QVector<Emulator::Output> outputs;
+    QVector<Step> steps;
+    for (int i=0; i<m_blocks.count(); i++) {
+        readSteps(i, &steps);
+        for (const Step &step : steps) {
+            if (step.output) {
+                outputs.append({(step.instruction + 1) * m_cyclesPerInstruction, step.a});
+            }
+        }
+    }
+    return outputs;
+}
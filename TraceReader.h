@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Emulator.h"
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+// Reads files written by TraceRecorder. The file is memory mapped, so only
+// the blocks that are actually looked at get read from disk.
+//
+// If the index at the end is missing (e.g. the program crashed before the
+// recorder was closed) the blocks are found by walking them from the start.
+class TraceReader
+{
+public:
+    struct Step
+    {
+        uint64_t instruction = 0; // how many instructions ran before this one
+        uint8_t pc = 0; // where the instruction was
+        uint8_t opcode = 0; // the byte at pc, including the operand with 8 bit instructions
+
+        // The state after the instruction
+        uint8_t nextPc = 0;
+        uint8_t a = 0;
+        uint8_t b = 0;
+        uint8_t sp = 0;
+        bool carry = false;
+        bool zero = false;
+        bool output = false;
+        bool halted = false;
+
+        int writtenAddress = -1;
+        uint8_t writtenValue = 0;
+
+        bool pushed = false; // to the stack at sp
+        uint8_t pushedValue = 0;
+    };
+
+    // The state before the first step in the block
+    struct Block
+    {
+        uint64_t firstInstruction = 0;
+        int stepCount = 0;
+        uint8_t pc = 0;
+        uint8_t a = 0;
+        uint8_t b = 0;
+        uint8_t sp = 0;
+        bool carry = false;
+        bool zero = false;
+        bool halted = false;
+        const uint8_t *memory = nullptr; // memorySize() bytes, in the mapped file
+        const uint8_t *stack = nullptr; // TraceRecorder::StackSize bytes
+
+        const uint8_t *records = nullptr;
+        int recordsSize = 0;
+    };
+
+    TraceReader() = default;
+    ~TraceReader();
+
+    bool open(const QString &path);
+    void close();
+    QString errorString() const { return m_errorString; }
+
+    int instructionSize() const { return m_instructionSize; }
+    int cyclesPerInstruction() const { return m_cyclesPerInstruction; }
+    int memorySize() const { return m_memorySize; }
+
+    int blockCount() const { return m_blocks.count(); }
+    const Block &block(const int index) const { return m_blocks[index]; }
+    uint64_t stepCount() const;
+
+    // Returns false if the block is corrupt, steps has what could be decoded
+    bool readSteps(const int blockIndex, QVector<Step> *steps) const;
+
+    // Everything the program wrote with out, like Emulator::outputs()
+    QVector<Emulator::Output> outputs() const;
+
+private:
+    bool parseBlock(const quint64 offset, Block *block) const;
+    bool readIndex();
+    bool scanBlocks();
+
+    QFile m_file;
+    const uint8_t *m_data = nullptr;
+    quint64 m_size = 0;
+
+    int m_instructionSize = 1;
+    int m_cyclesPerInstruction = 5;
+    int m_memorySize = 16;
+
+    QVector<Block> m_blocks;
+    QString m_errorString;
+};
@@ -0,0 +1,258 @@
+#include "TraceRecorder.h"
+
+#include "Emulator.h"
+
+namespace {
+// Everything is little endian
+void appendValue(QByteArray *data, const uint64_t value, const int bytes)
+{
+    for (int i=0; i<bytes; i++) {
+        data->append(char((value >> (i * 8)) & 0xFF));
+    }
+}
+
+void setValue(QByteArray *data, const int offset, const uint64_t value, const int bytes)
+{
+    for (int i=0; i<bytes; i++) {
+        (*data)[offset + i] = char((value >> (i * 8)) & 0xFF);
+    }
+}
+} // namespace
+
+TraceRecorder::~TraceRecorder()
+{
+    close();
+}
+
+bool TraceRecorder::open(const QString &path, const Emulator &emulator)
+{
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+
+    m_pcIncrement = emulator.instructionSize();
+    m_addressMask = emulator.addressMask();
+    m_steps = 0;
+    m_failed = false;
+    m_closing = false;
+    m_errorString.clear();
+    m_blockOffsets.clear();
+    m_queue.clear();
+
+    QByteArray header(FileMagic, sizeof FileMagic);
+    appendValue(&header, Version, 2);
+    appendValue(&header, emulator.instructionSize(), 1);
+    appendValue(&header, emulator.cyclesPerInstruction(), 1);
+    appendValue(&header, emulator.memorySize(), 2);
+    appendValue(&header, 0, 2);
+    Q_ASSERT(header.size() == FileHeaderSize);
+    if (m_file.write(header) != header.size()) {
+        m_errorString = m_file.errorString();
+        m_file.close();
+        return false;
+    }
+
+    startBlock(emulator);
+
+    m_writer = std::thread(&TraceRecorder::writeBlocks, this);
+    return true;
+}
+
+bool TraceRecorder::close()
+{
+    if (!isOpen()) {
+        return !m_failed;
+    }
+
+    finishBlock();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closing = true;
+    }
+    m_condition.notify_all();
+    m_writer.join();
+
+    if (!m_failed) {
+        QByteArray index;
+        for (const quint64 offset : m_blockOffsets) {
+            appendValue(&index, offset, 8);
+        }
+        appendValue(&index, m_blockOffsets.count(), 8);
+        index.append(IndexMagic, sizeof IndexMagic);
+        if (m_file.write(index) != index.size()) {
+            m_errorString = m_file.errorString();
+            m_failed = true;
+        }
+    }
+    m_file.close();
+
+    return !m_failed;
+}
+
+QString TraceRecorder::errorString() const
+{
+    return m_errorString;
+}
+
+void TraceRecorder::startBlock(const Emulator &emulator)
+{
+    const Emulator::State &state = emulator.state();
+
+    // The old one is still shared with the queue, so start a fresh one
+    m_block = QByteArray();
+    m_block.reserve(BlockHeaderSize + emulator.memorySize() + StackSize + BlockSize + 16);
+    m_block.append(BlockMagic, sizeof BlockMagic);
+    appendValue(&m_block, 0, 4); // size, filled in when finished
+    appendValue(&m_block, 0, 4); // steps
+    appendValue(&m_block, state.instructions, 8);
+    appendValue(&m_block, state.pc, 1);
+    appendValue(&m_block, state.a, 1);
+    appendValue(&m_block, state.b, 1);
+    appendValue(&m_block, state.sp, 1);
+    appendValue(&m_block, (state.carry ? Carry : 0) | (state.zero ? Zero : 0), 1);
+    appendValue(&m_block, state.halted ? Halted : 0, 1);
+    appendValue(&m_block, 0, 2);
+    Q_ASSERT(m_block.size() == BlockHeaderSize);
+
+    for (int address=0; address<emulator.memorySize(); address++) {
+        m_block.append(char(emulator.memory(address)));
+    }
+    for (int address=0; address<StackSize; address++) {
+        m_block.append(char(emulator.stack(uint8_t(address))));
+    }
+
+    m_blockSteps = 0;
+    m_pc = state.pc;
+    m_a = state.a;
+    m_b = state.b;
+    m_sp = state.sp;
+}
+
+void TraceRecorder::finishBlock()
+{
+    if (m_blockSteps == 0) {
+        return;
+    }
+    setValue(&m_block, 4, m_block.size(), 4);
+    setValue(&m_block, 8, m_blockSteps, 4);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]() { return int(m_queue.size()) < MaxQueuedBlocks || m_failed; });
+    if (!m_failed) {
+        m_queue.push_back(m_block);
+    }
+    lock.unlock();
+    m_condition.notify_all();
+
+    m_blockSteps = 0;
+}
+
+void TraceRecorder::record(const Emulator &emulator, const uint8_t opcode, const int writtenAddress, const bool pushed, const bool output)
+{
+    const Emulator::State &state = emulator.state();
+
+    uint8_t flags = 0;
+    if (state.pc != ((m_pc + m_pcIncrement) & m_addressMask)) {
+        flags |= Jumped;
+    }
+    if (state.a != m_a) {
+        flags |= AChanged;
+    }
+    if (state.b != m_b) {
+        flags |= BChanged;
+    }
+    if (state.carry) {
+        flags |= Carry;
+    }
+    if (state.zero) {
+        flags |= Zero;
+    }
+    if (writtenAddress >= 0) {
+        flags |= Written;
+    }
+    if (output) {
+        flags |= Output;
+    }
+
+    uint8_t moreFlags = 0;
+    if (state.halted) {
+        moreFlags |= Halted;
+    }
+    if (state.sp != m_sp) {
+        moreFlags |= SpChanged;
+    }
+    if (pushed) {
+        moreFlags |= Pushed;
+    }
+    if (moreFlags) {
+        flags |= More;
+    }
+
+    m_block.append(char(flags));
+    if (flags & More) {
+        m_block.append(char(moreFlags));
+    }
+    m_block.append(char(opcode));
+    if (flags & Jumped) {
+        m_block.append(char(state.pc));
+    }
+    if (flags & AChanged) {
+        m_block.append(char(state.a));
+    }
+    if (flags & BChanged) {
+        m_block.append(char(state.b));
+    }
+    if (flags & Written) {
+        m_block.append(char(writtenAddress));
+        m_block.append(char(emulator.memory(writtenAddress)));
+    }
+    if (moreFlags & SpChanged) {
+        m_block.append(char(state.sp));
+    }
+    if (moreFlags & Pushed) {
+        m_block.append(char(emulator.stack(state.sp)));
+    }
+
+    m_pc = state.pc;
+    m_a = state.a;
+    m_b = state.b;
+    m_sp = state.sp;
+    m_blockSteps++;
+    m_steps++;
+
+    if (m_block.size() >= BlockSize) {
+        finishBlock();
+        startBlock(emulator);
+    }
+}
+
+void TraceRecorder::writeBlocks()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_condition.wait(lock, [this]() { return !m_queue.empty() || m_closing; });
+        if (m_queue.empty()) {
+            return;
+        }
+        const QByteArray block = m_queue.front();
+        m_queue.pop_front();
+        lock.unlock();
+
+        // Only this thread touches the file until close()
+        const quint64 offset = m_file.pos();
+        const bool ok = m_file.write(block) == block.size();
+
+        lock.lock();
+        if (ok) {
+            m_blockOffsets.append(offset);
+        } else if (!m_failed) {
+            m_failed = true;
+            m_errorString = m_file.errorString();
+        }
+        m_condition.notify_all();
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+class Emulator;
+
+// Records every step the emulator takes to a file, so long runs can be
+// compared against what the hardware actually did.
+//
+// The file is a header followed by blocks, and an index of where the blocks
+// start at the end. Each block starts with the full state, memory and stack,
+// so it can be decoded on its own, followed by one record per step with only
+// what changed since the step before (usually two or three bytes). See
+// TraceReader for reading it back.
+//
+// Blocks are written by a background thread. If it falls behind, record()
+// waits for it instead of queueing up more, so memory use stays bounded no
+// matter how long the program runs.
+class TraceRecorder
+{
+public:
+    // What changed in a step, the first byte of each record
+    enum StepFlag : uint8_t {
+        Jumped = 1 << 0, // pc isn't right after the instruction, new pc follows
+        AChanged = 1 << 1, // new a follows
+        BChanged = 1 << 2, // new b follows
+        Carry = 1 << 3,
+        Zero = 1 << 4,
+        Written = 1 << 5, // address and value follow
+        Output = 1 << 6, // out, with the value in a
+        More = 1 << 7, // a byte with MoreFlags follows
+    };
+
+    // The rarer ones, so they don't cost anything when nothing happens
+    enum MoreFlag : uint8_t {
+        Halted = 1 << 0,
+        SpChanged = 1 << 1, // new sp follows
+        Pushed = 1 << 2, // value written to the stack at the new sp follows
+    };
+
+    static constexpr char FileMagic[8] = { '8', 'B', 'I', 'T', 'T', 'R', 'C', '1' };
+    static constexpr char BlockMagic[4] = { 'T', 'B', 'L', 'K' };
+    static constexpr char IndexMagic[8] = { 'T', 'R', 'C', 'I', 'N', 'D', 'E', 'X' };
+    static constexpr int FileHeaderSize = 16;
+    static constexpr int BlockHeaderSize = 28;
+    static constexpr int StackSize = 256; // always the whole thing, sp wraps around
+    static constexpr int Version = 2;
+
+    static constexpr int BlockSize = 64 * 1024; // roughly, a block is finished when it goes over
+    static constexpr int MaxQueuedBlocks = 16;
+
+    TraceRecorder() = default;
+    ~TraceRecorder();
+
+    // Writes the header and the current state of the emulator, then call
+    // Emulator::setTraceRecorder() to start recording.
+    bool open(const QString &path, const Emulator &emulator);
+
+    // Writes what's left and the index, returns false if anything failed
+    bool close();
+
+    bool isOpen() const { return m_writer.joinable(); }
+    QString errorString() const;
+
+    // Called by the emulator after each step. opcode is the byte at the old
+    // pc, writtenAddress is -1 if nothing was written to memory, and pushed
+    // is set if something was written to the stack at the new sp.
+    void record(const Emulator &emulator, const uint8_t opcode, const int writtenAddress, const bool pushed, const bool output);
+
+    uint64_t stepCount() const { return m_steps; }
+
+private:
+    void startBlock(const Emulator &emulator);
+    void finishBlock();
+    void writeBlocks();
+
+    QFile m_file;
+
+    QByteArray m_block;
+    int m_blockSteps = 0;
+    uint64_t m_steps = 0;
+
+    // Last recorded values, what the next step is compared against
+    uint8_t m_pc = 0;
+    uint8_t m_a = 0;
+    uint8_t m_b = 0;
+    uint8_t m_sp = 0;
+    uint8_t m_pcIncrement = 1;
+    uint8_t m_addressMask = 0xF;
+
+    // Shared with the writer thread
+    std::thread m_writer;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<QByteArray> m_queue;
+    QVector<quint64> m_blockOffsets;
+    bool m_closing = false;
+    bool m_failed = false;
+    QString m_errorString;
+};
@@ -0,0 +1,110 @@
+#include "Assembler.h"
+#include "CPU.h"
+#include "Emulator.h"
+
+#include <QStringList>
+
+#include <cstdint>
+#include <cstdlib>
+
+// libFuzzer harness for the assembler, see the README for how to run it.
+//
+// Every input is assembled for both bundled CPUs, and on top of not crashing
+// the results have to agree: assembling in one go and editing the second
+// half in afterwards must give the same memory, and the emulator has to end
+// up in the same state whether it runs decoded or one step at a time.
+
+namespace {
+void ignoreMessages(QtMsgType, const QMessageLogContext &, const QString &)
+{
+}
+
+struct Cpus
+{
+    Cpus() {
+        // The assembler and CPU loader are chatty, that just slows us down
+        qInstallMessageHandler(ignoreMessages);
+
+        if (!original.loadFile(":/cpu-original.txt") || !extended.loadFile(":/cpu-extended.txt")) {
+            abort();
+        }
+    }
+
+    CPU original;
+    CPU extended;
+};
+
+void checkIncremental(const CPU &cpu, const QString &source, const Assembler::Result &full)
+{
+    // Same line count from the start, with the second half blank
+    const QStringList lines = source.split('\n');
+    const int half = lines.count() / 2;
+    QStringList firstHalf = lines.mid(0, half);
+    for (int i=half; i<lines.count(); i++) {
+        firstHalf.append(QString());
+    }
+
+    Assembler assembler(cpu);
+    assembler.setSource(firstHalf.join('\n'));
+    assembler.reassemble();
+    assembler.replaceLines(half, lines.count() - half, lines.mid(half));
+    assembler.reassemble();
+
+    const Assembler::Result &incremental = assembler.result();
+    if (!(incremental.memory == full.memory) || incremental.hasErrors() != full.hasErrors()) {
+        abort();
+    }
+}
+
+void checkEmulator(const CPU &cpu, const MemoryImage &memory)
+{
+    static constexpr uint64_t maxInstructions = 1000;
+
+    Emulator decoded(cpu);
+    decoded.load(memory);
+    decoded.run(maxInstructions);
+
+    Emulator stepped(cpu);
+    stepped.load(memory);
+    for (uint64_t i=0; i<maxInstructions && stepped.step(); i++) {
+    }
+
+    const Emulator::State &a = decoded.state();
+    const Emulator::State &b = stepped.state();
+    if (a.a != b.a || a.b != b.b || a.pc != b.pc || a.sp != b.sp || a.out != b.out ||
+            a.carry != b.carry || a.zero != b.zero || a.halted != b.halted ||
+            a.cycles != b.cycles || a.instructions != b.instructions) {
+        abort();
+    }
+    if (decoded.outputs().count() != stepped.outputs().count()) {
+        abort();
+    }
+    for (int address=0; address<decoded.memorySize(); address++) {
+        if (decoded.memory(uint8_t(address)) != stepped.memory(uint8_t(address))) {
+            abort();
+        }
+    }
+}
+
+void check(const CPU &cpu, const QString &source)
+{
+    Assembler assembler(cpu);
+    const Assembler::Result full = assembler.assemble(source);
+
+    checkIncremental(cpu, source, full);
+
+    if (!full.hasErrors()) {
+        checkEmulator(cpu, full.memory);
+    }
+}
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static const Cpus cpus;
+
+    const QString source = QString::fromUtf8(reinterpret_cast<const char*>(data), int(size));
+    check(cpus.original, source);
+    check(cpus.extended, source);
+    return 0;
+}
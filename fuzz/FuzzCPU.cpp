@@ -0,0 +1,69 @@
+#include "Assembler.h"
+#include "CPU.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+// libFuzzer harness for the CPU description parser, see the README for how
+// to run it.
+//
+// Anything it accepts has to be usable: every operator has to be found again
+// through the lookup table, and assembling a line for each of them can't
+// crash.
+
+namespace {
+void ignoreMessages(QtMsgType, const QMessageLogContext &, const QString &)
+{
+}
+
+// Lookups are only case insensitive for ASCII, QString::toUpper() would
+// turn e.g. ß into SS
+QString asciiToUpper(QString name)
+{
+    for (QChar &c : name) {
+        if (c.unicode() >= 'a' && c.unicode() <= 'z') {
+            c = QChar(c.unicode() - ('a' - 'A'));
+        }
+    }
+    return name;
+}
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static const bool initialized = [] {
+        qInstallMessageHandler(ignoreMessages);
+        return true;
+    }();
+    Q_UNUSED(initialized);
+
+    CPU cpu;
+    if (!cpu.load(QByteArray::fromRawData(reinterpret_cast<const char*>(data), int(size)))) {
+        return 0;
+    }
+    if (!cpu.isValid()) {
+        abort();
+    }
+
+    QString source;
+    for (auto it = cpu.operators().constBegin(); it != cpu.operators().constEnd(); ++it) {
+        const CPU::Operator *found = cpu.findOperator(it.key());
+        if (!found || found->opcode != it.value().opcode) {
+            abort();
+        }
+        found = cpu.findOperator(asciiToUpper(it.key()));
+        if (!found || found->opcode != it.value().opcode) {
+            abort();
+        }
+
+        source += it.key();
+        for (int i=0; i<it.value().numArguments; i++) {
+            source += " 1";
+        }
+        source += '\n';
+    }
+
+    Assembler assembler(cpu);
+    assembler.assemble(source);
+    return 0;
+}